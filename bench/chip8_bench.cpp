@@ -0,0 +1,252 @@
+#include "chip8.hpp"
+#include "chip8_coro.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iterator>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define DEFAULT_CYCLES 20000000UL
+#define DRAW_CALLS 5000000L
+#define SCALE_FRAMES 1000
+// Ten seconds of each machine's time
+#define MACHINE_FRAMES 600
+#define MACHINE_RUNS 3
+
+using Seconds = std::chrono::duration<double>;
+
+struct BenchRom {
+    std::string name;
+    std::vector<u_int8_t> bytes;
+};
+
+static void emit(std::vector<u_int8_t> &bytes, u_int16_t op) {
+    bytes.push_back(op >> 8);
+    bytes.push_back(op & 0xFF);
+}
+
+// Assembles a ROM that repeats body forever; body is a list of opcodes starting at 0x200
+static BenchRom make_rom(std::string name, std::vector<u_int16_t> body) {
+    BenchRom rom{name, {}};
+    for (u_int16_t op : body) {
+        emit(rom.bytes, op);
+    }
+    emit(rom.bytes, 0x1200);
+    return rom;
+}
+
+// One ROM per opcode class, so the time per instruction reflects that class
+static std::vector<BenchRom> generated_roms() {
+    std::vector<BenchRom> roms;
+    roms.push_back(make_rom("alu", {
+        0x6001, 0x6102, 0x8014, 0x8015, 0x8011, 0x8012, 0x8013, 0x8016,
+        0x801E, 0x7003, 0x8107, 0x8010, 0x6255, 0x7201, 0x8124, 0x8225,
+    }));
+    roms.push_back(make_rom("branch", {
+        0x3000, 0x4001, 0x5010, 0x9010, 0x3101, 0x4100, 0x5120, 0x9120,
+        0x2240, 0x3000, 0x4001, 0x2240,
+    }));
+    // The subroutine called above sits at 0x240
+    roms.back().bytes.resize(0x40);
+    emit(roms.back().bytes, 0x00EE);
+    roms.push_back(make_rom("memory", {
+        0xA300, 0x6200, 0xF255, 0xF265, 0xF333, 0xF21E, 0xF155, 0xF065,
+    }));
+    roms.push_back(make_rom("draw", {
+        0xA000, 0x6000, 0x6100, 0xD015, 0x7009, 0xD015, 0x710B, 0xD01F,
+        0x7037, 0xD01F, 0x00E0,
+    }));
+    roms.push_back(make_rom("timers", {
+        0xC0FF, 0xF015, 0xF107, 0xF018, 0x610A, 0xF129,
+    }));
+    roms.push_back(make_rom("mixed", {
+        0x6000, 0x6100, 0xA000, 0xD015, 0x7008, 0x3040, 0x1204, 0x6000,
+        0x7106, 0x3118, 0x1204, 0xA300, 0xF233, 0xF265, 0x00E0,
+    }));
+    return roms;
+}
+
+static bool read_rom(const char *path, BenchRom &rom) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.good()) return false;
+    rom.name = path;
+    rom.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static void bench_rom(const BenchRom &rom, chip8::ExecEngine engine, unsigned long cycles) {
+    chip8::Chip8Emu emulator;
+    chip8::EmuOptions options;
+    options.engine = engine;
+    options.cycle_limit = cycles;
+    auto start = Clock::now();
+    int status = emulator.run_rom(rom.bytes.data(), rom.bytes.size(), options);
+    double elapsed = Seconds(Clock::now() - start).count();
+    std::cout << std::left << std::setw(24) << rom.name
+        << std::setw(13) << (engine == chip8::ENGINE_BLOCKS ? "blocks" : "interpreter");
+    if (status != 0) {
+        std::cout << "failed\n";
+        return;
+    }
+    std::cout << std::right << std::fixed
+        << std::setw(10) << std::setprecision(1) << (cycles / elapsed / 1e6) << " MIPS"
+        << std::setw(10) << std::setprecision(2) << (elapsed * 1e9 / cycles) << " ns/op\n";
+}
+
+template<bool Wrap>
+static void bench_draw(const char *label) {
+    chip8::Chip8Display display;
+    display.init();
+    const u_int8_t sprite[15] = {
+        0xF0, 0x90, 0x90, 0x90, 0xF0, 0x20, 0x60, 0x20, 0x20, 0x70, 0xFF, 0x81, 0x81, 0x81, 0xFF
+    };
+    int collisions = 0;
+    auto start = Clock::now();
+    for (long i = 0; i < DRAW_CALLS; i++) {
+        collisions += display.draw<Wrap>(sprite, (i * 7) & 0xFF, (i * 3) & 0xFF, 1 + (i % 15));
+    }
+    double elapsed = Seconds(Clock::now() - start).count();
+    std::cout << std::left << std::setw(37) << label << std::right << std::fixed
+        << std::setw(10) << std::setprecision(1) << (DRAW_CALLS / elapsed / 1e6) << " M/s "
+        << std::setw(10) << std::setprecision(2) << (elapsed * 1e9 / DRAW_CALLS) << " ns/call"
+        << "  (" << collisions << " collisions)\n";
+}
+
+// Alternates between two busy frames, so that with persistence every frame has pixels fading
+static void bench_scale(chip8::ScaleKernel kernel, int scale, double persistence) {
+    chip8::Framebuffer frames[2] = {};
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (chip8::PixelRow &row : frames[0][0]) {
+        for (int half = 0; half < 2; half++) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            row = (row << 64) | seed;
+        }
+    }
+    frames[1] = frames[0];
+    for (chip8::PixelRow &row : frames[1][0]) {
+        row = ~row;
+    }
+    chip8::FrameScaler scaler;
+    scaler.configure(scale, persistence, kernel);
+    uint32_t checksum = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < SCALE_FRAMES; i++) {
+        checksum += scaler.render(frames[i & 1], true)[i % (scaler.width() * scaler.height())];
+    }
+    double elapsed = Seconds(Clock::now() - start).count();
+    static const char *kernel_names[] = {"scalar", "sse2", "avx2"};
+    std::ostringstream label;
+    label << "scale " << kernel_names[kernel] << ' ' << scale << " (" << scaler.width() << 'x' << scaler.height()
+        << (persistence > 0 ? ", phosphor)" : ")");
+    std::cout << std::left << std::setw(37) << label.str() << std::right << std::fixed
+        << std::setw(10) << std::setprecision(0) << (elapsed * 1e9 / SCALE_FRAMES) << " ns/frame"
+        << std::setw(8) << std::setprecision(3)
+        << (elapsed * 1e9 / SCALE_FRAMES / (scaler.width() * scaler.height())) << " ns/pixel"
+        << "  (" << std::hex << checksum << std::dec << ")\n";
+}
+
+static size_t heap_in_use() {
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// Many copies of a program on one thread, resumed round robin for one frame at a time. Machines per core is how
+// many could run at 60 frames per second; the switch cost is the time over stepping the same machines in a plain
+// loop. Both are timed a few times, alternately, keeping the best, since with this many machines memory dominates.
+static void bench_machines(const BenchRom &rom, int count) {
+    chip8::EmuOptions options;
+    double elapsed = 1e9, plain_elapsed = 1e9;
+    size_t machine_bytes = 0;
+    for (int run = 0; run < MACHINE_RUNS; run++) {
+        size_t heap_before = heap_in_use();
+        chip8::MachineScheduler scheduler(chip8::SCHEDULE_ROUND_ROBIN);
+        for (int i = 0; i < count; i++) {
+            scheduler.add(rom.bytes.data(), rom.bytes.size(), options, MACHINE_FRAMES);
+        }
+        machine_bytes = (heap_in_use() - heap_before) / count;
+        auto start = Clock::now();
+        scheduler.run();
+        elapsed = std::min(elapsed, Seconds(Clock::now() - start).count());
+        std::vector<chip8::Chip8Emu> plain(count);
+        for (chip8::Chip8Emu &emulator : plain) {
+            emulator.load(rom.bytes.data(), rom.bytes.size(), options);
+        }
+        start = Clock::now();
+        for (int frame = 0; frame < MACHINE_FRAMES; frame++) {
+            for (chip8::Chip8Emu &emulator : plain) {
+                emulator.step_frames(1);
+            }
+        }
+        plain_elapsed = std::min(plain_elapsed, Seconds(Clock::now() - start).count());
+    }
+    double frames = static_cast<double>(count) * MACHINE_FRAMES;
+    std::ostringstream label;
+    label << "machines " << rom.name << " x" << count;
+    std::cout << std::left << std::setw(37) << label.str() << std::right << std::fixed
+        << std::setw(10) << std::setprecision(0) << (frames / elapsed / FRAME_RATE) << " /core"
+        << std::setw(9) << std::setprecision(0) << (elapsed * 1e9 / frames) << " ns/frame"
+        << std::setw(7) << std::setprecision(1) << ((elapsed - plain_elapsed) * 1e9 / frames) << " ns/switch"
+        << std::setw(8) << (machine_bytes / 1024) << " KiB/machine\n";
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long cycles = DEFAULT_CYCLES;
+    std::vector<BenchRom> roms;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cycles" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> cycles) || cycles == 0) {
+                std::cerr << "Invalid argument for cycles: " << argv[i] << '\n';
+                return -1;
+            }
+        } else {
+            BenchRom rom;
+            if (!read_rom(argv[i], rom)) {
+                std::cerr << "Could not open " << argv[i] << '\n';
+                return -1;
+            }
+            roms.push_back(rom);
+        }
+    }
+    if (roms.empty()) {
+        roms = generated_roms();
+    }
+#ifndef __OPTIMIZE__
+    std::cerr << "Warning: built without optimization; configure with -DCMAKE_BUILD_TYPE=Release\n";
+#endif
+    std::cout << cycles << " cycles per run, headless, unpaced\n";
+    for (const BenchRom &rom : roms) {
+        bench_rom(rom, chip8::ENGINE_INTERPRETER, cycles);
+        bench_rom(rom, chip8::ENGINE_BLOCKS, cycles);
+    }
+    bench_draw<false>("draw (DXYN, 1-15 rows, clipped)");
+    bench_draw<true>("draw (DXYN, 1-15 rows, wrapped)");
+    // Programs a 60Hz machine typically runs: busy every frame, polling the delay timer, and waiting for a key
+    std::vector<BenchRom> interactive = {
+        generated_roms().back(),
+        make_rom("delay-wait", {0x6003, 0xF015, 0xF007, 0x3000, 0x1204}),
+        make_rom("key-wait", {0xF00A}),
+    };
+    for (const BenchRom &rom : interactive) {
+        for (int count : {100, 1000}) {
+            bench_machines(rom, count);
+        }
+    }
+    // Scales are output pixels per high resolution pixel; the default window scale of 10 is 5
+    for (int kernel = chip8::SCALE_SCALAR; kernel <= chip8::FrameScaler::best_kernel(); kernel++) {
+        for (int scale : {1, 2, 3, 5, 8}) {
+            bench_scale(static_cast<chip8::ScaleKernel>(kernel), scale, 0);
+            bench_scale(static_cast<chip8::ScaleKernel>(kernel), scale, 0.75);
+        }
+    }
+    return 0;
+}
@@ -3,21 +3,42 @@
 
 #include <string>
 #include <array>
-#include <SDL2/SDL.h>
+#include <cstdint>
 #include <chrono>
+#include <vector>
+#include <ostream>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <bitset>
+#include <optional>
+#include <cstdio>
 
-// 4096 cells, 1B each = 4096B = 4KiB
-#define MEMCELL_MAX 4096
+// 65536 cells, 1B each = 64KiB, as on XO-CHIP; classic programs only use the first 4KiB
+#define MEMCELL_MAX 65536
+// The decode cache and translated blocks cover this much memory; code above it is decoded on every visit
+#define CACHED_MEMORY 4096
 // 16 cells, 2B each = 32B
 #define STACK_MAX 16
 
-#define REAL_WIDTH 64
-#define REAL_HEIGHT 32
+// SUPER-CHIP high resolution; low resolution uses the top left quarter
+#define SCREEN_WIDTH 128
+#define SCREEN_HEIGHT 64
+#define LORES_WIDTH 64
+#define LORES_HEIGHT 32
+// XO-CHIP bitplanes
+#define PLANES 2
+
+#define FRAME_RATE 60
 
 using Clock = std::chrono::steady_clock;
 using std::chrono::milliseconds;
 
 extern uint8_t FONT_DATA[];
+extern uint8_t BIG_FONT_DATA[];
+// The 8x10 SUPER-CHIP font follows the 4x5 font in memory
+#define BIG_FONT_ADDR 0x50
 
 namespace chip8 {
 
@@ -34,30 +55,168 @@ namespace chip8 {
         D, S, TIMERS_MAX
     };
 
+    // One 128 bit word per row; the most significant bit is the leftmost pixel
+    using PixelRow = unsigned __int128;
+    using Plane = std::array<PixelRow, SCREEN_HEIGHT>;
+    // Pixel value bit N comes from plane N
+    using Framebuffer = std::array<Plane, PLANES>;
+
+    inline bool pixel_at(const Framebuffer &framebuffer, int plane, int x, int y) {
+        return (framebuffer[plane][y] >> (SCREEN_WIDTH - 1 - x)) & 1;
+    }
+
+    // ARGB colour for each pixel value
+    using Palette = std::array<uint32_t, 1 << PLANES>;
+    extern const Palette DEFAULT_PALETTE;
+
+    // Where the display sends its pixels to be shown
+    class DisplayBackend {
+        public:
+            virtual ~DisplayBackend() = default;
+            // In low resolution only the top left LORES_WIDTH x LORES_HEIGHT pixels are in use
+            virtual void render(const Framebuffer &framebuffer, bool hires) = 0;
+            virtual void set_palette(const Palette &palette) { (void)palette; }
+            // While true the display renders every frame, even when nothing was drawn
+            virtual bool animating() const { return false; }
+    };
+
+    // Keeps the last rendered frame in memory; needs no video device
+    class HeadlessDisplayBackend : public DisplayBackend {
+        public:
+            void render(const Framebuffer &framebuffer, bool hires) override;
+            Framebuffer framebuffer = {};
+            bool hires = false;
+            unsigned long frames_rendered = 0;
+    };
+
+    enum ScaleKernel {
+        SCALE_SCALAR, SCALE_SSE2, SCALE_AVX2
+    };
+
+    // Expands the framebuffer into ARGB pixels at an integer scale, ready for a single texture upload. With
+    // persistence, each frame is blended with the last like a slow phosphor, so pixels that XOR drawing turns
+    // off and on again dim a little instead of flickering. Both steps run SSE2 or AVX2 kernels on x86-64.
+    class FrameScaler {
+        public:
+            FrameScaler() { configure(1, 0); set_palette(DEFAULT_PALETTE); }
+            // The best kernel this CPU can run
+            static ScaleKernel best_kernel();
+            // scale is output pixels per high resolution pixel; low resolution pixels come out twice as large.
+            // persistence is the fraction of the previous frame's colour kept each frame, from 0 up to below 1.
+            void configure(int scale, double persistence, ScaleKernel kernel = best_kernel());
+            void set_palette(const Palette &palette);
+            // Returns width() x height() pixels, row by row; valid until the next call
+            const uint32_t *render(const Framebuffer &framebuffer, bool hires);
+            int width() const { return SCREEN_WIDTH * scale; }
+            int height() const { return SCREEN_HEIGHT * scale; }
+            // Whether the last render left pixels still fading towards their colour
+            bool fading() const { return still_fading; }
+        private:
+            int scale;
+            // Persistence in 256ths
+            int keep;
+            ScaleKernel kernel;
+            // Colours of four pixels, indexed by their plane 0 bits and then their plane 1 bits, leftmost first
+            std::array<std::array<uint32_t, 4>, 256> nibble_colours;
+            // Colour of each high resolution pixel this frame, and as last shown
+            std::vector<uint32_t> target;
+            std::vector<uint32_t> shown;
+            std::vector<uint32_t> output;
+            bool primed = false;
+            bool still_fading = false;
+            void decode(const Framebuffer &framebuffer, bool hires);
+    };
+
+    struct MachineState;
+
     class Chip8Display {
         public:
             ~Chip8Display();
-            int init(std::string program, const short scaling_factor);
+            // Renders to backend, which the caller keeps ownership of, or headless when there is none
+            void init(DisplayBackend *backend = nullptr);
+            // Clears the selected planes
             void clear();
-            bool draw(u_int8_t *sprite_base_addr, int x, int y, int rows);
+            // Switching resolution clears the screen
+            void set_hires(bool enabled);
+            bool hires() const { return high_resolution; }
+            // XO-CHIP FN01: mask of the planes that drawing, clearing and scrolling affect
+            void select_planes(u_int8_t mask) { plane_mask = mask & ((1 << PLANES) - 1); }
+            // Scrolls move whole rows, or shift packed rows, of the selected planes by pixels of the
+            // current resolution
+            void scroll_down(int pixels);
+            void scroll_up(int pixels);
+            void scroll_right(int pixels);
+            void scroll_left(int pixels);
+            // rows 0 draws a 16x16 sprite. The sprite data for each selected plane follows the previous one's.
+            // Wrap selects whether sprites crossing the right or bottom edge wrap around or are clipped.
+            template<bool Wrap>
+            bool draw(const u_int8_t *sprite_base_addr, int x, int y, int rows);
+            // Bytes of sprite data the next draw reads
+            int sprite_bytes(int rows) const;
+            const Framebuffer &framebuffer() const { return planes; }
+            void set_palette(const Palette &palette);
+            void save_state(MachineState &state) const;
+            void load_state(const MachineState &state);
+            // Called at frame boundaries; skips the backend if nothing changed
+            void present();
         private:
-            SDL_Window *window;
-            SDL_Renderer *renderer;
-            bool pixels_on_screen[REAL_HEIGHT][REAL_WIDTH] = {};
-            void render_screen();
+            DisplayBackend *backend = nullptr;
+            HeadlessDisplayBackend *headless = nullptr;
+            Framebuffer planes = {};
+            bool high_resolution = false;
+            u_int8_t plane_mask = 1;
+            bool dirty = true;
     };
 
+    // Key state as a mask with bit N set while key N is down
     class Chip8Keypad {
         public:
-            void request_halting_input(u_int8_t *store_at);
-            void request_key(u_int8_t key, bool xor_mask);
-            void handle_input(SDL_Event *event, const Uint8 *kbstate, u_int16_t *program_counter);
+            // The key state the program sees until the next call; set once per frame
+            void set_keys(u_int16_t mask) { key_mask = mask; }
+            bool key_down(u_int8_t key) const { return key <= 0xF && (key_mask >> key) & 1; }
+            // FX0A: true with the key once one goes down that was not already held when the wait began.
+            // Until then the instruction is run again, so timers and the display keep going meanwhile.
+            bool poll_key_press(u_int8_t &key);
+            void save_state(MachineState &state) const;
+            void load_state(const MachineState &state);
         private:
-            bool halting_input_requested = false;
-            u_int8_t *storage_reg;
-            bool key_check_requested = false;
-            u_int8_t requested_key;
-            bool key_skip_xor_mask = 0;
+            u_int16_t key_mask = 0;
+            bool waiting_for_key = false;
+            u_int16_t keys_held_at_wait = 0;
+    };
+
+    // Lock-free ring for handing items from one producer thread to one consumer thread.
+    // Capacity must be a power of two; push fails rather than blocks when the ring is full.
+    template<typename T, size_t Capacity>
+    class SpscQueue {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+        public:
+            bool push(const T &item) {
+                size_t tail = write_pos.load(std::memory_order_relaxed);
+                if (tail - read_pos.load(std::memory_order_acquire) == Capacity) return false;
+                slots[tail & (Capacity - 1)] = item;
+                write_pos.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+            bool pop(T &item) {
+                size_t head = read_pos.load(std::memory_order_relaxed);
+                if (head == write_pos.load(std::memory_order_acquire)) return false;
+                item = slots[head & (Capacity - 1)];
+                read_pos.store(head + 1, std::memory_order_release);
+                return true;
+            }
+        private:
+            std::array<T, Capacity> slots;
+            // Kept on separate cache lines so the two sides do not contend
+            alignas(64) std::atomic<size_t> write_pos{0};
+            alignas(64) std::atomic<size_t> read_pos{0};
+    };
+
+    // What the sound hardware is doing for one 60Hz frame
+    struct SoundFrame {
+        bool active;    // ST is non-zero
+        u_int8_t pitch;
+        std::array<u_int8_t, 16> pattern;
     };
 
     struct Memory {
@@ -71,36 +230,628 @@ namespace chip8 {
         Chip8Keypad *keypad;
     };
 
+    // Returned by instruction handlers and the loops that run them; negative values are errors
+    enum ExecStatus {
+        EXEC_ERROR = -1, EXEC_OK = 0,
+        // The program jumped to itself and can make no further progress on its own
+        EXEC_HALTED = 1,
+        // The program is spinning in a loop that cannot exit before the timers or keys change at the next frame;
+        // Chip8Cpu::skip_idle_loop skips whole iterations of it
+        EXEC_IDLE = 2,
+        // The debugger was told to end the run; the instruction it stopped at has not run
+        EXEC_QUIT = 3
+    };
+
+    // FNV-1a; used to fingerprint framebuffers and programs
+    inline uint64_t hash_bytes(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325) {
+        const u_int8_t *bytes = static_cast<const u_int8_t *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3;
+        }
+        return hash;
+    }
+
+    struct Chip8Cpu;
+    struct DecodedInstr;
+    using InstrHandler = int (*)(Chip8Cpu &cpu, const DecodedInstr &instr);
+
+    // An instruction with its operands already extracted
+    struct DecodedInstr {
+        // NULL marks a cache entry that has to be decoded again
+        InstrHandler handler = nullptr;
+        u_int16_t opcode;
+        u_int16_t nnn;
+        u_int8_t x, y, n, nn;
+    };
+
+    // Behaviours that differ between CHIP-8 implementations; MODERN is what this emulator has always done. The
+    // SUPER-CHIP instructions only decode with SCHIP and XOCHIP, and the XO-CHIP ones only with XOCHIP.
+    enum QuirkProfile {
+        QUIRKS_MODERN, QUIRKS_VIP, QUIRKS_CHIP48, QUIRKS_SCHIP, QUIRKS_XOCHIP
+    };
+
+    DecodedInstr decode(u_int16_t instruction, QuirkProfile quirks = QUIRKS_MODERN);
+
+    // Longest straight-line run translated into one block
+    #define BLOCK_MAX_INSTRS 64
+
+    // A run of instructions up to the first branch, skip, key wait or RAM writing instruction
+    struct TranslatedBlock {
+        bool valid = false;
+        u_int16_t start;
+        u_int16_t end;  // One past the last byte
+        std::vector<DecodedInstr> instrs;
+        // The block that ran after this one last time, tried before the block table
+        TranslatedBlock *successor = nullptr;
+    };
+
+    enum ProfileSection {
+        PROFILE_DRAW, PROFILE_INPUT, PROFILE_PACING, PROFILE_SECTIONS
+    };
+
+    // Frame times are bucketed by powers of two microseconds
+    #define PROFILE_FRAME_BUCKETS 24
+    // Number of most executed addresses written to the report
+    #define PROFILE_HOT_PCS 32
+
+    // Execution counts per opcode class and per address, time spent in a few sections, and a frame time
+    // histogram. Only the profiled instantiations of the CPU loops touch it, so unprofiled runs pay nothing.
+    class Profiler {
+        public:
+            void count_instr(u_int16_t addr, u_int16_t opcode) {
+                ++class_counts[opcode >> 12];
+                ++pc_counts[addr];
+            }
+            void add_time(ProfileSection section, Clock::duration spent) { section_time[section] += spent; }
+            // spent is the time the frame took, not counting pacing
+            void record_frame(Clock::duration spent);
+            void write_json(std::ostream &out) const;
+            int dump(std::string path) const;
+        private:
+            std::array<u_int64_t, 16> class_counts = {};
+            std::array<u_int64_t, MEMCELL_MAX> pc_counts = {};
+            std::array<Clock::duration, PROFILE_SECTIONS> section_time = {};
+            std::array<u_int64_t, PROFILE_FRAME_BUCKETS> frame_buckets = {};
+            u_int64_t frames = 0;
+    };
+
+    // One executed instruction. Fixed size and stored in host byte order, so recording is a plain copy.
+    struct TraceRecord {
+        u_int64_t cycle;
+        // Registers after the instruction
+        std::array<u_int8_t, REG_MAX> regs;
+        u_int16_t addr;     // Where the instruction was fetched from
+        u_int16_t opcode;
+        u_int16_t I;
+        u_int16_t changed;  // Bit N set when VN differs from the previous record; filled in when dumped
+        u_int8_t SP;
+        int8_t status;      // What the handler returned
+    };
+
+    #define TRACE_MAGIC 0x52544843    // "CHTR" in a little-endian file
+    #define TRACE_VERSION 1
+
+    // Keeps the last records of execution in a preallocated ring; recording formats nothing and allocates nothing
+    class Tracer {
+        public:
+            // capacity is rounded up to a power of two
+            explicit Tracer(size_t capacity);
+            // The cycle number given to the next record
+            u_int64_t cycle = 0;
+            void record(u_int16_t addr, u_int16_t opcode, int status, const std::array<u_int8_t, REG_MAX> &regs,
+                    u_int16_t I, u_int8_t SP) {
+                TraceRecord &entry = ring[written++ & mask];
+                entry.cycle = cycle++;
+                entry.regs = regs;
+                entry.addr = addr;
+                entry.opcode = opcode;
+                entry.I = I;
+                entry.SP = SP;
+                entry.status = status;
+            }
+            // Writes the records held, oldest first, after a header of magic, version, record size and count
+            int dump(std::string path);
+        private:
+            std::vector<TraceRecord> ring;
+            size_t mask;
+            u_int64_t written = 0;
+    };
+
+    int read_trace(std::string path, std::vector<TraceRecord> &records);
+
+    // Interactive debugger, consulted before every instruction by the debug instantiations of the CPU loops.
+    // Whenever execution stops, commands are read a line at a time from the console or from one client of a
+    // local Unix socket, until one resumes execution.
+    class Debugger {
+        public:
+            ~Debugger();
+            // Reads commands from stdin, or from the first client to connect to socket_path when one is given
+            int open(std::string socket_path = "");
+            // Stops for commands on a breakpoint, a watched RAM access or after the last single step. Returns
+            // EXEC_QUIT when told to end the run, EXEC_OK otherwise.
+            int check(Chip8Cpu &cpu, u_int16_t addr, const DecodedInstr &instr) {
+                bool stepped = steps && --steps == 0;
+                if (!stepped && !breakpoints[addr] && !(watching && accesses_watched(cpu, instr))) {
+                    return EXEC_OK;
+                }
+                return stop(cpu, addr, instr);
+            }
+        private:
+            // Indexed by address; instructions may start at odd addresses, so every byte has a bit
+            std::bitset<MEMCELL_MAX> breakpoints;
+            std::bitset<MEMCELL_MAX> read_watches;
+            std::bitset<MEMCELL_MAX> write_watches;
+            bool watching = false;
+            // Instructions left to run before stopping; 0 runs until something else stops execution
+            u_int64_t steps = 1;
+            FILE *in = stdin;
+            FILE *out = stdout;
+            int client = -1;
+            // The RAM range the instruction is about to read or write, from its opcode and I
+            bool memory_access(const Chip8Cpu &cpu, const DecodedInstr &instr, u_int16_t &start, int &length,
+                    bool &writes) const;
+            bool accesses_watched(const Chip8Cpu &cpu, const DecodedInstr &instr) const;
+            int stop(Chip8Cpu &cpu, u_int16_t addr, const DecodedInstr &instr);
+            void set_watch(u_int16_t start, int length, int kinds, bool on);
+            void print_registers(const Chip8Cpu &cpu, u_int16_t addr) const;
+            void print_stack(const Chip8Cpu &cpu) const;
+            void print_memory(const Chip8Cpu &cpu, u_int16_t start, int length) const;
+            void print_points() const;
+            // After the input closes the program runs on as if there were no debugger
+            void detach();
+    };
+
+    // Instrumentation compiled into an instantiation of the CPU loops; uninstrumented runs pay nothing for it
+    enum ExecHooks {
+        HOOK_NONE = 0,
+        // Report every instruction to Chip8Cpu::profiler
+        HOOK_PROFILE = 1,
+        // Record every instruction in Chip8Cpu::tracer
+        HOOK_TRACE = 2,
+        // Consult Chip8Cpu::debugger before every instruction
+        HOOK_DEBUG = 4,
+        HOOK_ALL = 7
+    };
+
+    enum ExecEngine {
+        ENGINE_INTERPRETER, ENGINE_BLOCKS
+    };
+
     struct Chip8Cpu {
         Chip8Cpu(Memory *memory, Chip8Display *display, Chip8Keypad *keypad);
         Bus bus;
         std::array<u_int8_t, REG_MAX> regs = {};
-        u_int8_t SP;    // Stack Pointer
-        u_int16_t PC;   // Program Counter
-        u_int16_t I;    // Index Register
+        u_int8_t SP = 0;    // Stack Pointer
+        u_int16_t PC = 0;   // Program Counter
+        u_int16_t I = 0;    // Index Register
         std::array<u_int8_t, TIMERS_MAX> timers = {};
+        // SUPER-CHIP FX75/FX85 storage
+        std::array<u_int8_t, REG_MAX> flag_regs = {};
+        // XO-CHIP sound: a 128 sample 1-bit pattern played while ST is non-zero, at 4000*2^((pitch-64)/48) Hz
+        std::array<u_int8_t, 16> audio_pattern = {};
+        u_int8_t pitch = 64;
+        // Called once per 60Hz frame
         void decrement_timers();
+        // Each CPU has its own generator for CXNN, so instances never share state
+        void seed_random(u_int32_t seed);
+        u_int8_t next_random();
+        void save_state(MachineState &state) const;
+        void load_state(const MachineState &state);
+        // Hooks is a mask of ExecHooks; the objects its hooks report to must be set
+        template<int Hooks = HOOK_NONE>
         int exec_next();
+        // Runs translated blocks until max_cycles instructions have run
+        template<int Hooks = HOOK_NONE>
+        int exec_blocks(long max_cycles, long &executed);
+        Profiler *profiler = nullptr;
+        Tracer *tracer = nullptr;
+        Debugger *debugger = nullptr;
+        // The loop behind the last EXEC_IDLE, and the register it loads the delay timer into, if any
+        u_int8_t idle_loop_instrs = 0;
+        u_int8_t idle_timer_reg = REG_MAX;
+        // Accounts for as many whole iterations of the loop behind the last EXEC_IDLE as fit in cycles, without
+        // running them, and returns the cycles they take
+        long skip_idle_loop(long cycles);
+        // All RAM writes made by instructions go through here to keep the decode cache coherent
+        void write_ram(u_int16_t addr, u_int8_t value);
+        // For writes to RAM from outside the CPU, such as loading a program
+        void invalidate_decode_cache();
+        // Instructions decoded from here on use the profile's handlers
+        void set_quirks(QuirkProfile profile);
+        private:
+            // One entry per even address; instructions at odd addresses are not cached
+            std::array<DecodedInstr, CACHED_MEMORY / 2> decode_cache = {};
+            // Indexed by start address; only allocated once the block engine is used
+            std::vector<TranslatedBlock> blocks;
+            // Number of valid blocks covering each RAM byte
+            std::vector<u_int8_t> block_coverage;
+            u_int32_t rng_state = 1;
+            QuirkProfile quirks = QUIRKS_MODERN;
+            inline u_int16_t fetch_instr(u_int16_t addr);
+            TranslatedBlock *translate(u_int16_t addr);
+            void invalidate_blocks(u_int16_t addr);
+            void drop_block(TranslatedBlock &block);
+    };
+
+    // Paces frames at a fixed rate: sleeps through most of the wait, then spins up to the deadline
+    class FramePacer {
+        public:
+            explicit FramePacer(double frames_per_second);
+            // idle frames sleep all the way to the deadline instead of spinning the last stretch
+            void wait_next_frame(bool idle = false);
+            void report_jitter() const;
+        private:
+            Clock::duration frame_period;
+            Clock::time_point next_deadline;
+            bool started = false;
+            // How late each frame started compared to its deadline
+            double jitter_total_us = 0;
+            double jitter_max_us = 0;
+            unsigned long frames_paced = 0;
+    };
+
+    #define STATE_MAGIC 0x53384843    // "C8HS" in a little-endian file
+    #define STATE_VERSION 4
+
+    // Everything needed to resume a machine, laid out as one block so it can be written and mapped directly.
+    // Fields are stored in host byte order.
+    struct MachineState {
+        u_int32_t magic;
+        u_int32_t version;
+        u_int64_t cycles_executed;
+        double cycle_carry;
+        Framebuffer framebuffer;
+        std::array<u_int8_t, MEMCELL_MAX> ram;
+        std::array<u_int16_t, STACK_MAX> stack;
+        std::array<u_int8_t, REG_MAX> regs;
+        std::array<u_int8_t, TIMERS_MAX> timers;
+        u_int16_t PC;
+        u_int16_t I;
+        u_int8_t SP;
+        u_int32_t rng_state;
+        std::array<u_int8_t, REG_MAX> flag_regs;
+        std::array<u_int8_t, 16> audio_pattern;
+        u_int8_t pitch;
+        u_int8_t hires;
+        u_int8_t plane_mask;
+        // An FX0A wait in progress
+        u_int8_t waiting_for_key;
+        u_int16_t keys_held_at_wait;
+    };
+
+    // Run-length coding of an XOR difference: pairs of (zero run, literal run) lengths as varints, each literal
+    // run followed by its bytes. Unchanged data XORs to long zero runs.
+    void encode_delta(const u_int8_t *current, const u_int8_t *base, size_t size, std::vector<u_int8_t> &out);
+    // Applies an encoded difference of in_size bytes to the size bytes of data in place. False, with data partly
+    // changed, when the encoding is cut short, runs past size or has bytes left over.
+    bool apply_delta(const u_int8_t *in, size_t in_size, u_int8_t *data, size_t size);
+
+    // Keeps the most recent frames of machine state. Every keyframe_interval frames a full state is stored;
+    // the frames in between only store their XOR difference to that keyframe, run-length encoded.
+    // Storage is one preallocated byte ring; the oldest keyframe and its deltas are evicted together.
+    class RewindBuffer {
+        public:
+            RewindBuffer(size_t max_frames, size_t capacity_bytes, unsigned keyframe_interval);
+            void push(const MachineState &state);
+            // Takes the newest frame off the buffer; false when there is nothing left
+            bool pop(MachineState &state);
+            size_t frames() const { return entries.size(); }
+            size_t bytes_used() const { return used; }
         private:
-            u_int16_t instruction;
-            inline void fetch_instr();
-            std::chrono::time_point<Clock> last_time_stamp = Clock::now();
+            struct Entry {
+                size_t offset;
+                size_t size;
+                bool keyframe;
+            };
+            size_t max_frames;
+            unsigned keyframe_interval;
+            unsigned frames_since_keyframe = 0;
+            std::vector<u_int8_t> ring;
+            size_t head = 0;    // Where the next entry is written
+            size_t used = 0;
+            std::deque<Entry> entries;
+            // The full state of the keyframe the newest entry belongs to
+            MachineState keyframe;
+            std::vector<u_int8_t> scratch;
+            void store(const std::vector<u_int8_t> &encoded, size_t size, bool is_keyframe);
+            void evict_oldest();
+            void read(const Entry &entry, std::vector<u_int8_t> &out) const;
+            void decode_keyframe_for_newest();
+    };
+
+    #define MOVIE_VERSION 2
+
+    // Keypad state changes keyed by cycle, plus what is needed to reproduce the run they were recorded from.
+    // Recordings always start from a freshly loaded program.
+    class InputMovie {
+        public:
+            struct Event {
+                u_int64_t cycle;
+                u_int16_t keys;
+            };
+            u_int32_t seed = 1;
+            u_int64_t program_hash = 0;
+            double cycles_per_frame = 0;
+            QuirkProfile quirks = QUIRKS_MODERN;
+            u_int64_t end_cycle = 0;
+            std::vector<Event> events;
+            // Only stores a change from the previous key state
+            void record(u_int64_t cycle, u_int16_t keys);
+            // Forgets everything recorded after cycle, for when the machine is rewound
+            void truncate(u_int64_t cycle);
+            // Key state in effect at cycle; cycles must not go backwards between calls
+            u_int16_t keys_at(u_int64_t cycle);
+            int save(std::string path) const;
+            int load(std::string path);
+        private:
+            size_t next_event = 0;
+            u_int16_t current_keys = 0;
+    };
+
+    struct VideoFrame {
+        Framebuffer framebuffer;
+        bool hires;
+    };
+
+    #define VIDEO_VERSION 1
+    // Frames the recorder can fall behind by before it starts dropping them
+    #define VIDEO_QUEUE_FRAMES 64
+
+    // Records the framebuffer once per frame. Frames go through a bounded queue to a writer thread, which stores
+    // each one as its difference to the previous frame, so the frame loop never waits on the disk.
+    class VideoRecorder {
+        public:
+            ~VideoRecorder() { close(); }
+            // When the writer falls too far behind, frames are dropped and counted if drop_when_behind is set,
+            // which paced runs need; otherwise capture waits for the writer to make room
+            int open(std::string path, bool drop_when_behind);
+            void capture(const Framebuffer &framebuffer, bool hires);
+            // Writes out everything queued and stops the writer
+            int close();
+            unsigned long frames_captured() const { return captured; }
+            unsigned long frames_dropped() const { return dropped; }
+        private:
+            void write_frames();
+            std::ofstream out;
+            std::thread writer;
+            std::atomic<bool> stopping{false};
+            std::atomic<bool> write_failed{false};
+            SpscQueue<VideoFrame, VIDEO_QUEUE_FRAMES> frames;
+            unsigned long captured = 0;
+            unsigned long dropped = 0;
+            bool drop_when_behind = true;
+            std::string path;
+    };
+
+    // Writes each frame of a recording as a binary PBM named PREFIX000000.pbm, PREFIX000001.pbm, ...;
+    // a pixel is set when it is set in any plane
+    int export_video_pbm(std::string video_path, std::string prefix);
+
+    struct EmuOptions;
+    class Chip8Emu;
+
+    // Requests from the user to the run loop
+    enum HostCommand {
+        HOST_NONE, HOST_QUIT, HOST_SAVE_STATE, HOST_LOAD_STATE, HOST_WRITE_PROFILE
+    };
+
+    // The host side of an interactive run: a window for the display, keyboard input, hotkeys and sound. The core
+    // only talks to the host through this interface and needs no SDL; chip8_sdl.hpp has the SDL frontend.
+    class Frontend {
+        public:
+            virtual ~Frontend() = default;
+            // Where the display renders to, or NULL to render headless; owned by the frontend
+            virtual DisplayBackend *display_backend() = 0;
+            // Called as a run starts and after it ends
+            virtual void start() {}
+            virtual void stop() {}
+            // Called at the start of every frame until it returns HOST_NONE
+            virtual HostCommand next_command() = 0;
+            // The keypad state for the next frame
+            virtual u_int16_t frame_keys() = 0;
+            // While this holds, the run steps one frame back per frame instead of running
+            virtual bool rewinding() = 0;
+            // Called at the end of every frame
+            virtual void play(const SoundFrame &frame) = 0;
+    };
+
+    struct EmuOptions {
+        short cpu_freq = 540;
+        // Instructions per 60Hz frame; 0 derives it from cpu_freq
+        short cycles_per_frame = 0;
+        // Runs with a frontend are shown, take input and are paced in real time; runs without one are
+        // headless and run as fast as they can
+        Frontend *frontend = nullptr;
+        ExecEngine engine = ENGINE_INTERPRETER;
+        QuirkProfile quirks = QUIRKS_MODERN;
+        // Stop after this many instructions; 0 runs until the window is closed
+        unsigned long cycle_limit = 0;
+        // Stop once the program jumps to itself
+        bool stop_on_halt = false;
+        // Save state to resume from after loading the program; F5/F9 save to and load from it.
+        // Defaults to the program path with a .state suffix.
+        std::string state_file;
+        bool resume_from_state = false;
+        // Seconds of history kept for rewinding, while the frontend asks for it; 0 turns recording off
+        short rewind_seconds = 0;
+        // Seed for CXNN's random numbers
+        u_int32_t seed = 1;
+        // Record keypad input to this file
+        std::string record_file;
+        // Feed keypad input from this recording instead of the keyboard; the recording's seed and
+        // cycles per frame replace the options, and the run ends where the recording ended
+        std::string replay_file;
+        // Profile the run and write the report here on exit, or on F7
+        std::string profile_file;
+        Palette palette = DEFAULT_PALETTE;
+        // Skip the rest of a frame spent waiting for the delay timer or a key, or halted. Results are the
+        // same cycle for cycle; profiled runs never skip so every instruction is counted.
+        bool skip_idle = true;
+        // Record the framebuffer of every frame to this file
+        std::string video_file;
+        // Keep a trace of the last trace_records instructions and write it here when the run ends, whether
+        // by halting, by an error or otherwise
+        std::string trace_file;
+        size_t trace_records = 65536;
+        // Start stopped in the debugger, taking commands from the console or, when debug_socket is set, from a
+        // client of that Unix socket
+        bool debug = false;
+        std::string debug_socket;
     };
 
     class Chip8Emu {
         public:
             Chip8Emu();
             ~Chip8Emu();
-            int run_program(std::string program, const short display_scaling_factor, const short cpu_freq);
+            int run_program(std::string program, const EmuOptions &options);
+            // Same as run_program, with the program already in memory instead of a file.
+            // hash is the program's hash_bytes if the caller already has it, or 0.
+            int run_rom(const u_int8_t *rom, size_t size, const EmuOptions &options, uint64_t hash = 0);
+            // Compares CPU, memory and display state with another emulator
+            bool same_state(const Chip8Emu &other) const;
+            const Chip8Cpu &cpu_state() const { return *cpu; }
+            const Framebuffer &framebuffer() const { return display->framebuffer(); }
+            unsigned long cycles_run() const { return cycles_executed; }
+            // Whether the last run ended because the program halted
+            bool halted() const { return program_halted; }
+            // Fingerprint of the full machine state, for comparing runs
+            uint64_t state_hash() const;
+            void save_state(MachineState &state) const;
+            int load_state(const MachineState &state);
+            int save_state_file(std::string path) const;
+            // Maps the file and restores straight from the mapping
+            int load_state_file(std::string path);
+            // Same as run_program, resuming from a saved state instead of loading a program
+            int run_state(const MachineState &state, const EmuOptions &options);
+            // For embedding: loads the program and applies the machine options (timing, engine, quirks, seed,
+            // idle skipping, stopping on halt) without starting a run, so the caller can drive the machine
+            // from its own loop with step_cycles and step_frames. Nothing is shown, played or recorded.
+            // Loading again starts the new program on a machine reset to its power-on state.
+            int load(const u_int8_t *rom, size_t size, const EmuOptions &options);
+            // Runs instructions, ticking the timers at frame boundaries exactly as a full run would, so runs
+            // split into any number of steps match. 1 when the program halted and stop_on_halt is set,
+            // -1 on errors, including when no program was loaded, 0 otherwise.
+            int step_cycles(unsigned long cycles);
+            // Runs to the end of the current frame, frames times
+            int step_frames(unsigned long frames);
+            // The keypad state from now on; bit N is set while key N is down
+            void set_keys(u_int16_t mask) { keypad->set_keys(mask); }
+            bool hires() const { return display->hires(); }
+            // Whether the last frame stepped ended early waiting for the delay timer or a key, or halted
+            bool frame_was_idle() const { return frame_idle; }
         private:
             std::string runnig_program;
             Chip8Display *display;
             Chip8Keypad *keypad;
             Memory *memory;
             Chip8Cpu *cpu;
+            unsigned long cycles_executed = 0;
+            double cycle_carry = 0;
+            // Set by load for step_cycles and step_frames, which fail until it succeeded; cycles of the current
+            // frame not yet run
+            bool loaded = false;
+            double step_cycles_per_frame = 0;
+            long frame_cycles_left = 0;
             int load_program();
+            // Starts from the power-on state, so loading into a machine that already ran keeps nothing of it
+            int load_rom(const u_int8_t *rom, size_t size, uint64_t hash = 0);
+            // The power-on state: RAM blank but for the fonts, registers, stack, timers and screen cleared
+            void reset();
+            // Deletes the profiler, debugger and tracer of the last run and takes them off the CPU
+            void detach_hooks();
+            int run_loaded(const EmuOptions &options);
+            ExecEngine engine = ENGINE_INTERPRETER;
+            bool stop_on_halt = false;
+            bool program_halted = false;
+            bool skip_idle = false;
+            // Whether the last frame ended in an idle skip
+            bool frame_idle = false;
+            std::string state_path;
+            RewindBuffer *rewind_buffer = nullptr;
+            uint64_t program_hash = 0;
+            InputMovie movie;
+            bool recording_input = false;
+            bool replaying_input = false;
+            Profiler *profiler = nullptr;
+            std::string profile_path;
+            VideoRecorder *video = nullptr;
+            Tracer *tracer = nullptr;
+            std::string trace_path;
+            Debugger *debugger = nullptr;
+            void handle_command(HostCommand command);
+            int run_frame(double cycles_per_frame, unsigned long cycle_limit, u_int16_t keys);
+            // Runs cycles through the CPU loop instantiated for the hooks in use
+            int run_hooked(long cycles, long &executed);
+            // Starts the next frame of a stepped run; false for a frame with no cycles, which is then over
+            bool begin_step_frame();
+            // Like run_frame, for the part of a frame step_cycles runs
+            int run_step(long cycles);
+            template<int Hooks>
+            int run_cycles(long cycles, long &executed);
     };
 
+    struct CorpusEntry {
+        std::string name;
+        size_t offset;
+        size_t size;
+        uint64_t hash;
+    };
+
+    // An index over many ROMs held in one block of memory. A tar archive is mapped as it is; the files of a
+    // directory, or whatever arrives on stdin, are read into one buffer. Each file is opened once, when indexing.
+    class RomCorpus {
+        public:
+            ~RomCorpus();
+            // A directory of ROM files, a tar archive of them, or "-" for a tar archive or single ROM on stdin
+            int open(std::string path);
+            const std::vector<CorpusEntry> &entries() const { return index; }
+            const u_int8_t *rom(const CorpusEntry &entry) const { return base + entry.offset; }
+        private:
+            const u_int8_t *base = nullptr;
+            size_t length = 0;
+            void *mapping = nullptr;
+            std::vector<u_int8_t> buffer;
+            std::vector<CorpusEntry> index;
+            int open_directory(std::string path);
+            int open_archive(std::string path);
+            int read_stdin();
+            // Indexes base as a tar archive
+            int index_archive(std::string path);
+            void add_entry(std::string name, size_t offset, size_t size);
+    };
+
+    struct BatchJob {
+        std::string program;
+        unsigned long cycle_budget;
+        // Set for jobs from a corpus; the program is then already in memory and only names the job
+        const u_int8_t *rom = nullptr;
+        size_t rom_size = 0;
+        uint64_t rom_hash = 0;
+        // Per-ROM settings over the batch's options; 0 and no value keep those
+        short cycles_per_frame = 0;
+        std::optional<QuirkProfile> quirks;
+    };
+
+    struct BatchResult {
+        // 0 when the job used its whole budget or halted
+        int status = -1;
+        bool halted = false;
+        unsigned long cycles = 0;
+        uint64_t framebuffer_hash = 0;
+        std::array<u_int8_t, REG_MAX> regs = {};
+        u_int16_t PC = 0;
+        u_int16_t I = 0;
+        u_int8_t SP = 0;
+    };
+
+    // Reads one job per line: PROGRAM [CYCLES]; blank lines and lines starting with # are skipped
+    int read_batch_jobs(std::string list_file, unsigned long default_budget, std::vector<BatchJob> &jobs);
+    // One job per ROM in the corpus, which must outlive the jobs
+    void corpus_batch_jobs(const RomCorpus &corpus, unsigned long budget, std::vector<BatchJob> &jobs);
+    // Runs every job on its own headless machine, spread over a work-stealing pool of threads
+    std::vector<BatchResult> run_batch(const std::vector<BatchJob> &jobs, const EmuOptions &options, unsigned threads);
+    void print_batch_results(std::ostream &out, const std::vector<BatchJob> &jobs, const std::vector<BatchResult> &results);
+
 }
 
 #endif
@@ -0,0 +1,116 @@
+#include "chip8_sdl.hpp"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+namespace chip8 {
+
+    int AudioOutput::open(int buffer_samples) {
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+            std::cerr << "Could not initialize audio: " << SDL_GetError() << '\n';
+            return -1;
+        }
+        SDL_AudioSpec desired = {};
+        SDL_AudioSpec obtained;
+        desired.freq = AUDIO_SAMPLE_RATE;
+        desired.format = AUDIO_S16SYS;
+        desired.channels = 1;
+        desired.samples = buffer_samples;
+        desired.callback = on_audio;
+        desired.userdata = this;
+        device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+        if (device == 0) {
+            std::cerr << "Could not open audio device: " << SDL_GetError() << '\n';
+            SDL_QuitSubSystem(SDL_INIT_AUDIO);
+            return -1;
+        }
+        sample_rate = obtained.freq;
+        this->buffer_samples = obtained.samples;
+        current = {};
+        phase = 0;
+        callback_count.store(0, std::memory_order_relaxed);
+        underrun_count.store(0, std::memory_order_relaxed);
+        has_pending = false;
+        overrun_count = 0;
+        SDL_PauseAudioDevice(device, 0);
+        return 0;
+    }
+
+    void AudioOutput::close() {
+        if (device != 0) {
+            // Returns once the callback has finished, so nothing touches this object afterwards
+            SDL_CloseAudioDevice(device);
+            SDL_QuitSubSystem(SDL_INIT_AUDIO);
+            device = 0;
+        }
+    }
+
+    void AudioOutput::publish(const SoundFrame &frame) {
+        // The frame left waiting is older, so it goes first
+        if (has_pending && frames.push(pending)) has_pending = false;
+        if (!has_pending && frames.push(frame)) return;
+        if (has_pending) overrun_count++;
+        pending = frame;
+        has_pending = true;
+    }
+
+    void AudioOutput::on_audio(void *userdata, Uint8 *stream, int len) {
+        AudioOutput *audio = static_cast<AudioOutput *>(userdata);
+        auto now = Clock::now();
+        if (audio->callback_count.fetch_add(1, std::memory_order_relaxed) > 0) {
+            // The device asks for the next buffer as the previous one runs out; asking this late means
+            // it played silence in between
+            auto buffer_time = std::chrono::duration<double>(static_cast<double>(audio->buffer_samples)
+                    / audio->sample_rate);
+            if (now - audio->last_callback > buffer_time * 1.5) {
+                audio->underrun_count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        audio->last_callback = now;
+        SoundFrame frame;
+        while (audio->frames.pop(frame)) {
+            audio->current = frame;
+        }
+        audio->fill(reinterpret_cast<int16_t *>(stream), len / sizeof(int16_t));
+    }
+
+    void AudioOutput::fill(int16_t *samples, int count) {
+        if (!current.active) {
+            std::fill(samples, samples + count, 0);
+            phase = 0;
+            return;
+        }
+        bool has_pattern = false;
+        for (u_int8_t byte : current.pattern) {
+            has_pattern |= byte != 0;
+        }
+        if (!has_pattern) {
+            // phase counts periods of the beep
+            phase = std::fmod(phase, 1.0);
+            const double step = static_cast<double>(AUDIO_BEEP_HZ) / sample_rate;
+            for (int i = 0; i < count; i++) {
+                samples[i] = phase < 0.5 ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+                phase += step;
+                if (phase >= 1) phase -= 1;
+            }
+            return;
+        }
+        // phase counts pattern bits, played at 4000*2^((pitch-64)/48) bits per second
+        const double step = 4000 * std::exp2((current.pitch - 64) / 48.0) / sample_rate;
+        for (int i = 0; i < count; i++) {
+            int bit = static_cast<int>(phase);
+            bool high = (current.pattern[bit >> 3] >> (7 - (bit & 7))) & 1;
+            samples[i] = high ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+            phase += step;
+            if (phase >= 128) phase -= 128;
+        }
+    }
+
+    void AudioOutput::report_buffers() const {
+        unsigned long total = callbacks();
+        if (total == 0) return;
+        std::cerr << "Audio: " << total << " buffers of " << buffer_samples << " samples, "
+            << underruns() << " underruns, " << overruns() << " overruns\n";
+    }
+
+}
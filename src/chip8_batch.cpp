@@ -0,0 +1,153 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <deque>
+
+namespace {
+
+    // Each worker owns one queue; it pops its own jobs from the back and steals from the front of others
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    bool pop_own(WorkQueue &queue, size_t &job) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.jobs.empty()) return false;
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(WorkQueue &queue, size_t &job) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.jobs.empty()) return false;
+        job = queue.jobs.front();
+        queue.jobs.pop_front();
+        return true;
+    }
+
+}
+
+namespace chip8 {
+
+    int read_batch_jobs(std::string list_file, unsigned long default_budget, std::vector<BatchJob> &jobs) {
+        std::ifstream list(list_file);
+        if (!list.good()) {
+            std::cerr << "Could not open job list " << list_file << '\n';
+            return -1;
+        }
+        std::string line;
+        int line_number = 0;
+        while (std::getline(list, line)) {
+            ++line_number;
+            std::istringstream ss(line);
+            BatchJob job;
+            if (!(ss >> job.program) || job.program[0] == '#') continue;
+            if (!(ss >> job.cycle_budget)) {
+                if (!ss.eof()) {
+                    std::cerr << list_file << ':' << line_number << ": invalid cycle budget\n";
+                    return -1;
+                }
+                job.cycle_budget = default_budget;
+            }
+            jobs.push_back(job);
+        }
+        return 0;
+    }
+
+    void corpus_batch_jobs(const RomCorpus &corpus, unsigned long budget, std::vector<BatchJob> &jobs) {
+        for (const CorpusEntry &entry : corpus.entries()) {
+            BatchJob job;
+            job.program = entry.name;
+            job.cycle_budget = budget;
+            job.rom = corpus.rom(entry);
+            job.rom_size = entry.size;
+            job.rom_hash = entry.hash;
+            jobs.push_back(job);
+        }
+    }
+
+    static BatchResult run_job(const BatchJob &job, EmuOptions options) {
+        BatchResult result;
+        options.frontend = nullptr;
+        options.cycle_limit = job.cycle_budget;
+        options.stop_on_halt = true;
+        if (job.cycles_per_frame) {
+            options.cycles_per_frame = job.cycles_per_frame;
+        }
+        if (job.quirks) {
+            options.quirks = *job.quirks;
+        }
+        Chip8Emu emulator;
+        result.status = job.rom ? emulator.run_rom(job.rom, job.rom_size, options, job.rom_hash)
+            : emulator.run_program(job.program, options);
+        const Chip8Cpu &cpu = emulator.cpu_state();
+        const Framebuffer &framebuffer = emulator.framebuffer();
+        result.halted = emulator.halted();
+        result.cycles = emulator.cycles_run();
+        result.framebuffer_hash = hash_bytes(framebuffer.data(), sizeof(Framebuffer));
+        result.regs = cpu.regs;
+        result.PC = cpu.PC;
+        result.I = cpu.I;
+        result.SP = cpu.SP;
+        return result;
+    }
+
+    std::vector<BatchResult> run_batch(const std::vector<BatchJob> &jobs, const EmuOptions &options, unsigned threads) {
+        std::vector<BatchResult> results(jobs.size());
+        if (jobs.empty()) return results;
+        if (threads == 0) threads = 1;
+        if (threads > jobs.size()) threads = jobs.size();
+        std::vector<WorkQueue> queues(threads);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            queues[i % threads].jobs.push_back(i);
+        }
+        auto worker = [&](unsigned id) {
+            size_t job;
+            for (;;) {
+                bool found = pop_own(queues[id], job);
+                for (unsigned k = 1; !found && k < threads; k++) {
+                    found = steal(queues[(id + k) % threads], job);
+                }
+                // Nothing is queued after start, so empty queues everywhere means we are done
+                if (!found) return;
+                results[job] = run_job(jobs[job], options);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned id = 0; id < threads; id++) {
+            pool.emplace_back(worker, id);
+        }
+        for (std::thread &thread : pool) {
+            thread.join();
+        }
+        return results;
+    }
+
+    void print_batch_results(std::ostream &out, const std::vector<BatchJob> &jobs, const std::vector<BatchResult> &results) {
+        for (size_t i = 0; i < jobs.size(); i++) {
+            const BatchResult &result = results[i];
+            out << jobs[i].program;
+            if (result.status != 0) {
+                out << " error\n";
+                continue;
+            }
+            out << (result.halted ? " halted" : " budget") << " cycles=" << std::dec << result.cycles
+                << std::hex << std::setfill('0')
+                << " fb=" << std::setw(16) << result.framebuffer_hash
+                << " pc=" << std::setw(3) << (0x200 + result.PC)
+                << " i=" << std::setw(3) << result.I
+                << " sp=" << std::setw(2) << +result.SP << " v=";
+            for (u_int8_t reg : result.regs) {
+                out << std::setw(2) << +reg;
+            }
+            out << std::dec << std::setfill(' ') << '\n';
+        }
+    }
+
+}
@@ -0,0 +1,114 @@
+#include "chip8.hpp"
+#include "libchip8.h"
+#include <algorithm>
+#include <climits>
+#include <new>
+
+struct chip8_machine {
+    chip8::Chip8Emu emulator;
+    chip8::EmuOptions options;
+    std::array<uint8_t, SCREEN_WIDTH * SCREEN_HEIGHT> pixels;
+};
+
+static_assert(static_cast<int>(CHIP8_QUIRKS_XOCHIP) == chip8::QUIRKS_XOCHIP, "chip8_quirks must match QuirkProfile");
+static_assert(static_cast<int>(CHIP8_ENGINE_BLOCKS) == chip8::ENGINE_BLOCKS, "chip8_engine must match ExecEngine");
+
+extern "C" {
+
+int chip8_api_version(void) {
+    return CHIP8_API_VERSION;
+}
+
+void chip8_default_config(chip8_config *config) {
+    chip8::EmuOptions defaults;
+    config->cycles_per_frame = defaults.cpu_freq / FRAME_RATE;
+    config->quirks = CHIP8_QUIRKS_MODERN;
+    config->engine = CHIP8_ENGINE_INTERPRETER;
+    config->seed = defaults.seed;
+    config->skip_idle = defaults.skip_idle;
+    config->stop_on_halt = defaults.stop_on_halt;
+}
+
+chip8_machine *chip8_create(const chip8_config *config) {
+    chip8_config defaults;
+    if (config == NULL) {
+        chip8_default_config(&defaults);
+        config = &defaults;
+    }
+    // EmuOptions holds the rate in a short
+    if (config->cycles_per_frame <= 0 || config->cycles_per_frame > SHRT_MAX
+            || config->quirks < CHIP8_QUIRKS_MODERN || config->quirks > CHIP8_QUIRKS_XOCHIP
+            || config->engine < CHIP8_ENGINE_INTERPRETER || config->engine > CHIP8_ENGINE_BLOCKS) {
+        return NULL;
+    }
+    chip8_machine *machine = new (std::nothrow) chip8_machine;
+    if (machine == NULL) {
+        return NULL;
+    }
+    machine->options.cycles_per_frame = config->cycles_per_frame;
+    machine->options.quirks = static_cast<chip8::QuirkProfile>(config->quirks);
+    machine->options.engine = static_cast<chip8::ExecEngine>(config->engine);
+    machine->options.seed = config->seed;
+    machine->options.skip_idle = config->skip_idle != 0;
+    machine->options.stop_on_halt = config->stop_on_halt != 0;
+    return machine;
+}
+
+void chip8_destroy(chip8_machine *machine) {
+    delete machine;
+}
+
+int chip8_load_rom(chip8_machine *machine, const uint8_t *rom, size_t size) {
+    return machine->emulator.load(rom, size, machine->options);
+}
+
+int chip8_run_cycles(chip8_machine *machine, unsigned long cycles) {
+    return machine->emulator.step_cycles(cycles);
+}
+
+int chip8_run_frames(chip8_machine *machine, unsigned long frames) {
+    return machine->emulator.step_frames(frames);
+}
+
+void chip8_set_keys(chip8_machine *machine, uint16_t mask) {
+    machine->emulator.set_keys(mask);
+}
+
+const uint8_t *chip8_framebuffer(chip8_machine *machine, int *width, int *height) {
+    const chip8::Framebuffer &framebuffer = machine->emulator.framebuffer();
+    bool hires = machine->emulator.hires();
+    int columns = hires ? SCREEN_WIDTH : LORES_WIDTH;
+    int rows = hires ? SCREEN_HEIGHT : LORES_HEIGHT;
+    uint8_t *pixel = machine->pixels.data();
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < columns; x++) {
+            *pixel++ = chip8::pixel_at(framebuffer, 0, x, y) | (chip8::pixel_at(framebuffer, 1, x, y) << 1);
+        }
+    }
+    if (width) *width = columns;
+    if (height) *height = rows;
+    return machine->pixels.data();
+}
+
+uint64_t chip8_framebuffer_hash(const chip8_machine *machine) {
+    return chip8::hash_bytes(machine->emulator.framebuffer().data(), sizeof(chip8::Framebuffer));
+}
+
+unsigned long chip8_cycles(const chip8_machine *machine) {
+    return machine->emulator.cycles_run();
+}
+
+void chip8_registers(const chip8_machine *machine, uint8_t *regs) {
+    const chip8::Chip8Cpu &cpu = machine->emulator.cpu_state();
+    std::copy(cpu.regs.begin(), cpu.regs.end(), regs);
+}
+
+uint16_t chip8_pc(const chip8_machine *machine) {
+    return (0x200 + machine->emulator.cpu_state().PC) & (MEMCELL_MAX - 1);
+}
+
+uint16_t chip8_index(const chip8_machine *machine) {
+    return machine->emulator.cpu_state().I;
+}
+
+}
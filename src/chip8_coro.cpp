@@ -0,0 +1,78 @@
+#include "chip8_coro.hpp"
+#include <thread>
+
+namespace chip8 {
+
+    static const Clock::duration FRAME_PERIOD = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / FRAME_RATE));
+
+    MachineTask MachineScheduler::frame_loop(Chip8Emu &emulator, unsigned long frames) {
+        for (unsigned long frame = 1; ; frame++) {
+            int status = emulator.step_frames(1);
+            if (status != 0 || frame == frames) {
+                co_return status;
+            }
+            co_await std::suspend_always();
+        }
+    }
+
+    int MachineScheduler::add(const u_int8_t *rom, size_t size, const EmuOptions &options, unsigned long frames) {
+        std::unique_ptr<Machine> machine(new Machine());
+        if (machine->emulator.load(rom, size, options) != 0) {
+            return -1;
+        }
+        machine->task = frame_loop(machine->emulator, frames);
+        machine->deadline = Clock::now();
+        machines.push_back(std::move(machine));
+        int id = machines.size() - 1;
+        queue(id);
+        return id;
+    }
+
+    void MachineScheduler::queue(int id) {
+        if (policy == SCHEDULE_ROUND_ROBIN) {
+            ready.push_back(id);
+        } else {
+            due.emplace(machines[id]->deadline, id);
+        }
+    }
+
+    bool MachineScheduler::resume_next() {
+        int id;
+        if (policy == SCHEDULE_ROUND_ROBIN) {
+            if (ready.empty()) return false;
+            id = ready.front();
+            ready.pop_front();
+        } else {
+            if (due.empty()) return false;
+            id = due.top().second;
+            due.pop();
+        }
+        Machine &machine = *machines[id];
+        if (policy == SCHEDULE_DEADLINE) {
+            auto now = Clock::now();
+            if (machine.deadline > now) {
+                std::this_thread::sleep_until(machine.deadline);
+            } else if (now - machine.deadline > FRAME_PERIOD) {
+                // Resync after a stall instead of bursting through the missed frames
+                ++late;
+                machine.deadline = now;
+            }
+            // Absolute deadlines, so rounding never accumulates
+            machine.deadline += FRAME_PERIOD;
+        }
+        machine.task.handle.resume();
+        ++frames;
+        if (!machine.task.handle.done()) {
+            queue(id);
+        }
+        return true;
+    }
+
+    void MachineScheduler::run() {
+        while (resume_next()) {
+            // Next machine
+        }
+    }
+
+}
@@ -0,0 +1,91 @@
+#ifndef CHIP8_CORO_H
+#define CHIP8_CORO_H
+
+#include "chip8.hpp"
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <utility>
+
+// Many machines on one thread. Each machine's frame loop is a coroutine that hands the thread back at every frame
+// boundary, and a frame spent waiting on the delay timer or a key (FX0A) ends as soon as the wait is seen, so a
+// waiting machine costs little more than the switch. Machines share nothing; hosts wanting more cores run one
+// scheduler per thread.
+
+namespace chip8 {
+
+    // The coroutine type of a machine's frame loop. It starts suspended and only its scheduler resumes it.
+    class MachineTask {
+        public:
+            struct promise_type {
+                int status = 0;
+                MachineTask get_return_object() {
+                    return MachineTask(std::coroutine_handle<promise_type>::from_promise(*this));
+                }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                // Stays suspended at the end, so the scheduler can read the status
+                std::suspend_always final_suspend() noexcept { return {}; }
+                void return_value(int status) { this->status = status; }
+                void unhandled_exception() { std::terminate(); }
+            };
+            MachineTask() = default;
+            MachineTask(MachineTask &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+            MachineTask &operator=(MachineTask &&other) noexcept {
+                std::swap(handle, other.handle);
+                return *this;
+            }
+            ~MachineTask() { if (handle) handle.destroy(); }
+            std::coroutine_handle<promise_type> handle;
+        private:
+            explicit MachineTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    };
+
+    enum SchedulePolicy {
+        // Every machine in turn, as fast as the thread allows; for batch work and benchmarks
+        SCHEDULE_ROUND_ROBIN,
+        // Every machine at 60 frames per second, earliest deadline first, sleeping while none is due
+        SCHEDULE_DEADLINE
+    };
+
+    class MachineScheduler {
+        public:
+            explicit MachineScheduler(SchedulePolicy policy = SCHEDULE_DEADLINE) : policy(policy) {}
+            // Loads the program into a new machine (see Chip8Emu::load) and queues it to start right away.
+            // It finishes after frames frames, or never when 0, unless it halts with stop_on_halt or fails.
+            // Returns the machine's id, or -1 if the program could not be loaded.
+            int add(const u_int8_t *rom, size_t size, const EmuOptions &options, unsigned long frames = 0);
+            // Runs one frame of the machine due next; false once every machine has finished
+            bool resume_next();
+            // Runs until every machine has finished
+            void run();
+            // Machines may be inspected, and given keys, between resumes
+            Chip8Emu &machine(int id) { return machines[id]->emulator; }
+            bool finished(int id) const { return machines[id]->task.handle.done(); }
+            // Once finished: 1 if the program halted, -1 on errors, 0 when its frames ran out
+            int status(int id) const { return machines[id]->task.handle.promise().status; }
+            size_t size() const { return machines.size(); }
+            unsigned long frames_run() const { return frames; }
+            // Frames started more than a frame after their deadline, with SCHEDULE_DEADLINE
+            unsigned long frames_late() const { return late; }
+        private:
+            struct Machine {
+                Chip8Emu emulator;
+                MachineTask task;
+                Clock::time_point deadline;
+            };
+            using Due = std::pair<Clock::time_point, int>;
+            static MachineTask frame_loop(Chip8Emu &emulator, unsigned long frames);
+            SchedulePolicy policy;
+            std::vector<std::unique_ptr<Machine>> machines;
+            // Machines waiting their turn; round robin uses the queue, deadline order the heap
+            std::deque<int> ready;
+            std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due;
+            unsigned long frames = 0;
+            unsigned long late = 0;
+            void queue(int id);
+    };
+
+}
+
+#endif
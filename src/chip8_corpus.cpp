@@ -0,0 +1,153 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// tar stores files in 512 byte blocks, each preceded by a one block header
+#define TAR_BLOCK 512
+
+namespace chip8 {
+
+    RomCorpus::~RomCorpus() {
+        if (mapping) {
+            munmap(mapping, length);
+        }
+    }
+
+    int RomCorpus::open(std::string path) {
+        if (path == "-") {
+            return read_stdin();
+        }
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            std::cerr << "Could not open " << path << '\n';
+            return -1;
+        }
+        return S_ISDIR(info.st_mode) ? open_directory(path) : open_archive(path);
+    }
+
+    void RomCorpus::add_entry(std::string name, size_t offset, size_t size) {
+        index.push_back({name, offset, size, hash_bytes(base + offset, size)});
+    }
+
+    int RomCorpus::open_directory(std::string path) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == NULL) {
+            std::cerr << "Could not open " << path << '\n';
+            return -1;
+        }
+        std::vector<std::string> names;
+        while (struct dirent *entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+        }
+        closedir(dir);
+        // Sorted so jobs come out in the same order on every run
+        std::sort(names.begin(), names.end());
+        std::vector<std::pair<std::string, size_t>> files;
+        for (const std::string &name : names) {
+            std::string file = path + "/" + name;
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd < 0) continue;
+            struct stat info;
+            if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+                close(fd);
+                continue;
+            }
+            size_t offset = buffer.size();
+            buffer.resize(offset + info.st_size);
+            ssize_t got = pread(fd, &buffer[offset], info.st_size, 0);
+            close(fd);
+            if (got != info.st_size) {
+                std::cerr << "Could not read " << file << '\n';
+                return -1;
+            }
+            files.push_back({name, offset});
+        }
+        // Offsets are only turned into entries once the buffer has stopped moving
+        base = buffer.data();
+        for (size_t i = 0; i < files.size(); i++) {
+            size_t end = i + 1 < files.size() ? files[i + 1].second : buffer.size();
+            add_entry(files[i].first, files[i].second, end - files[i].second);
+        }
+        return 0;
+    }
+
+    int RomCorpus::open_archive(std::string path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Could not open " << path << '\n';
+            return -1;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            std::cerr << path << " is empty\n";
+            close(fd);
+            return -1;
+        }
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            std::cerr << "Could not map " << path << '\n';
+            return -1;
+        }
+        base = static_cast<const u_int8_t *>(mapping);
+        length = info.st_size;
+        return index_archive(path);
+    }
+
+    int RomCorpus::read_stdin() {
+        u_int8_t chunk[1 << 16];
+        ssize_t got;
+        while ((got = read(STDIN_FILENO, chunk, sizeof chunk)) > 0) {
+            buffer.insert(buffer.end(), chunk, chunk + got);
+        }
+        if (got < 0 || buffer.empty()) {
+            std::cerr << "Nothing to read from stdin\n";
+            return -1;
+        }
+        base = buffer.data();
+        // Anything that is not a tar archive is taken as a single ROM
+        if (buffer.size() < TAR_BLOCK || std::memcmp(&buffer[257], "ustar", 5) != 0) {
+            add_entry("-", 0, buffer.size());
+            return 0;
+        }
+        return index_archive("stdin");
+    }
+
+    int RomCorpus::index_archive(std::string path) {
+        size_t size = mapping ? length : buffer.size();
+        size_t pos = 0;
+        while (pos + TAR_BLOCK <= size) {
+            const char *header = reinterpret_cast<const char *>(base + pos);
+            // The archive ends with zero blocks
+            if (header[0] == '\0') break;
+            if (std::memcmp(header + 257, "ustar", 5) != 0) {
+                std::cerr << path << " is not a tar archive\n";
+                return -1;
+            }
+            std::string name(header, strnlen(header, 100));
+            std::string prefix(header + 345, strnlen(header + 345, 155));
+            if (!prefix.empty()) name = prefix + "/" + name;
+            size_t file_size = strtoull(std::string(header + 124, strnlen(header + 124, 12)).c_str(), NULL, 8);
+            size_t data = pos + TAR_BLOCK;
+            if (file_size > size - data) {
+                std::cerr << path << " is truncated at " << name << '\n';
+                return -1;
+            }
+            // Regular files only; directories, links and extended headers are skipped
+            char type = header[156];
+            if ((type == '0' || type == '\0') && file_size > 0) {
+                add_entry(name, data, file_size);
+            }
+            pos = data + (file_size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        }
+        return 0;
+    }
+
+}
@@ -1,5 +1,6 @@
 #include "chip8.hpp"
 #include <iostream>
+#include <algorithm>
 
 #define REG_X(instr) ((instr & 0x0F00) >> 8)
 #define REG_Y(instr) ((instr & 0x00F0) >> 4)
@@ -7,13 +8,7 @@
 #define NN(instr) (instr & 0x00FF)
 #define N(instr) (instr & 0x000F)
 
-inline void store_decimal(u_int8_t *storage_base_addr, int number) {
-    int i = 2;
-    while (i >= 0) {
-        storage_base_addr[i--] = number % 10;
-        number /= 10;
-    }
-}
+#define ADDR_MASK (MEMCELL_MAX - 1)
 
 inline u_int16_t font_addr(u_int8_t font) {
     return (5 * font);
@@ -21,216 +16,797 @@ inline u_int16_t font_addr(u_int8_t font) {
 
 namespace chip8 {
 
-    Chip8Cpu::Chip8Cpu(Memory *memory, Chip8Display *display, Chip8Keypad *keypad) {
-        bus.memory = memory;
-        bus.display = display;
-        bus.keypad = keypad;
+    // Where FX55/FX65 leave I afterwards
+    enum IndexAdvance {
+        INDEX_KEEP, INDEX_ADD_X, INDEX_ADD_X_PLUS_1
+    };
+
+    // Quirk policies. Handlers that differ between variants are instantiated once per policy and the
+    // right instantiation is picked when an instruction is decoded, so none of these are tested at run time.
+    struct ModernQuirks {
+        // 8XY6/8XYE shift VY into VX instead of shifting VX in place
+        static constexpr bool shift_uses_vy = false;
+        // BNNN is BXNN, adding VX instead of V0
+        static constexpr bool jump_uses_vx = false;
+        static constexpr IndexAdvance index_advance = INDEX_KEEP;
+        // 8XY1/8XY2/8XY3 clear VF
+        static constexpr bool logic_resets_vf = false;
+        // Sprites crossing the right or bottom edge continue on the other side instead of being clipped
+        static constexpr bool sprites_wrap = false;
+        // Skips step over all four bytes of F000 NNNN
+        static constexpr bool long_skips = false;
+        // Whether the SUPER-CHIP and XO-CHIP instructions decode; without them 00CN, 00DN and 00FB-00FF are
+        // ignored like other machine routines, DXY0 draws nothing, 5XY2/5XY3 compare like 5XY0 and the new FX
+        // instructions are illegal, as on the original machines
+        static constexpr bool schip_opcodes = false;
+        static constexpr bool xochip_opcodes = false;
+    };
+
+    struct VipQuirks : ModernQuirks {
+        static constexpr bool shift_uses_vy = true;
+        static constexpr IndexAdvance index_advance = INDEX_ADD_X_PLUS_1;
+        static constexpr bool logic_resets_vf = true;
+    };
+
+    struct Chip48Quirks : ModernQuirks {
+        static constexpr bool jump_uses_vx = true;
+        static constexpr IndexAdvance index_advance = INDEX_ADD_X;
+    };
+
+    struct SchipQuirks : ModernQuirks {
+        static constexpr bool jump_uses_vx = true;
+        static constexpr bool schip_opcodes = true;
+    };
+
+    struct XochipQuirks : ModernQuirks {
+        static constexpr bool shift_uses_vy = true;
+        static constexpr IndexAdvance index_advance = INDEX_ADD_X_PLUS_1;
+        static constexpr bool sprites_wrap = true;
+        static constexpr bool long_skips = true;
+        static constexpr bool schip_opcodes = true;
+        static constexpr bool xochip_opcodes = true;
+    };
+
+    template<class Quirks>
+    static inline void skip_next(Chip8Cpu &cpu) {
+        if (Quirks::long_skips) {
+            u_int16_t next = (0x200 + cpu.PC) & ADDR_MASK;
+            const Memory &memory = *cpu.bus.memory;
+            if (memory.ram[next] == 0xF0 && memory.ram[(next + 1) & ADDR_MASK] == 0x00) {
+                cpu.PC += 2;
+            }
+        }
+        cpu.PC += 2;
     }
 
-    void Chip8Cpu::decrement_timers() {
-        auto current_time_stamp = Clock::now();
-        milliseconds duration = std::chrono::duration_cast<milliseconds>(current_time_stamp - last_time_stamp);
-        milliseconds min_ms_elapsed = static_cast<milliseconds>(17);
-        if (duration >= min_ms_elapsed) {
-            last_time_stamp = current_time_stamp;
-            if (timers[D]) --timers[D];
-            if (timers[S]) --timers[S];
+    // Instruction handlers; PC already points past the instruction when these run
+
+    static int op_nop(Chip8Cpu &, const DecodedInstr &) {
+        // Ignore; unimplemented machine instructions
+        return 0;
+    }
+
+    static int op_cls(Chip8Cpu &cpu, const DecodedInstr &) {
+        cpu.bus.display->clear();
+        return 0;
+    }
+
+    static int op_ret(Chip8Cpu &cpu, const DecodedInstr &) {
+        if (cpu.SP == 0) {
+            std::cerr << "Return with an empty stack\n";
+            return -1;
         }
+        cpu.PC = cpu.bus.memory->stack[--cpu.SP];
+        return 0;
     }
 
-    inline void Chip8Cpu::fetch_instr() {
-        instruction = (bus.memory->ram[0x200 + PC] << 8) + (bus.memory->ram[0x200 + PC + 1]);
-        PC += 2;
+    static int op_scroll_down(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.bus.display->scroll_down(instr.n);
+        return 0;
     }
 
-    int Chip8Cpu::exec_next() {
-        fetch_instr();
+    static int op_scroll_up(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.bus.display->scroll_up(instr.n);
+        return 0;
+    }
+
+    static int op_scroll_right(Chip8Cpu &cpu, const DecodedInstr &) {
+        cpu.bus.display->scroll_right(4);
+        return 0;
+    }
+
+    static int op_scroll_left(Chip8Cpu &cpu, const DecodedInstr &) {
+        cpu.bus.display->scroll_left(4);
+        return 0;
+    }
+
+    static int op_exit(Chip8Cpu &cpu, const DecodedInstr &) {
+        // Stay on this instruction, as a jump to itself would
+        cpu.PC -= 2;
+        return EXEC_HALTED;
+    }
+
+    static int op_lores(Chip8Cpu &cpu, const DecodedInstr &) {
+        cpu.bus.display->set_hires(false);
+        return 0;
+    }
+
+    static int op_hires(Chip8Cpu &cpu, const DecodedInstr &) {
+        cpu.bus.display->set_hires(true);
+        return 0;
+    }
+
+    // Whether the loop at addr is FX07 followed by 3XNN or 4XNN, and with the jump back after them would keep
+    // spinning until the delay timer changes. VX may be stale, so the skip is judged on the timer itself.
+    static bool waits_for_timer(const Chip8Cpu &cpu, u_int16_t addr, u_int8_t &x) {
+        const std::array<u_int8_t, MEMCELL_MAX> &ram = cpu.bus.memory->ram;
+        u_int8_t load = ram[addr & ADDR_MASK];
+        u_int8_t skip = ram[(addr + 2) & ADDR_MASK];
+        x = load & 0xF;
+        if ((load >> 4) != 0xF || ram[(addr + 1) & ADDR_MASK] != 0x07 || (skip & 0xF) != x) {
+            return false;
+        }
+        bool equal = cpu.timers[D] == ram[(addr + 3) & ADDR_MASK];
+        return ((skip >> 4) == 0x3 && !equal) || ((skip >> 4) == 0x4 && equal);
+    }
+
+    static int op_jp(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        u_int16_t target = instr.nnn - 0x0200;
+        u_int16_t from = cpu.PC - 2;
+        int status = EXEC_OK;
+        u_int8_t x;
+        if (target == from) {
+            // Jumping to itself is how programs stop
+            status = EXEC_HALTED;
+        } else if (target == static_cast<u_int16_t>(from - 4) && waits_for_timer(cpu, instr.nnn, x)) {
+            cpu.idle_loop_instrs = 3;
+            cpu.idle_timer_reg = x;
+            status = EXEC_IDLE;
+        }
+        cpu.PC = target;
+        return status;
+    }
+
+    static int op_call(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        if (cpu.SP >= STACK_MAX) {
+            std::cerr << "Stack overflow\n";
+            return -1;
+        }
+        cpu.bus.memory->stack[cpu.SP++] = cpu.PC;
+        cpu.PC = instr.nnn - 0x0200;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_se_imm(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        if (cpu.regs[instr.x] == instr.nn) skip_next<Quirks>(cpu);
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_sne_imm(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        if (cpu.regs[instr.x] != instr.nn) skip_next<Quirks>(cpu);
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_se_reg(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        if (cpu.regs[instr.x] == cpu.regs[instr.y]) skip_next<Quirks>(cpu);
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_sne_reg(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        if (cpu.regs[instr.x] != cpu.regs[instr.y]) skip_next<Quirks>(cpu);
+        return 0;
+    }
+
+    static int op_save_range(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        // 5XY2: VX to VY, in either direction, to I onwards; I is left alone
+        int step = instr.x <= instr.y ? 1 : -1;
+        for (int reg = instr.x, at = 0; ; reg += step, at++) {
+            cpu.write_ram(cpu.I + at, cpu.regs[reg]);
+            if (reg == instr.y) break;
+        }
+        return 0;
+    }
+
+    static int op_load_range(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        int step = instr.x <= instr.y ? 1 : -1;
+        for (int reg = instr.x, at = 0; ; reg += step, at++) {
+            cpu.regs[reg] = cpu.bus.memory->ram[(cpu.I + at) & ADDR_MASK];
+            if (reg == instr.y) break;
+        }
+        return 0;
+    }
+
+    static int op_ld_imm(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] = instr.nn;
+        return 0;
+    }
+
+    static int op_add_imm(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] += instr.nn;
+        return 0;
+    }
+
+    static int op_ld_reg(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] = cpu.regs[instr.y];
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_or(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] |= cpu.regs[instr.y];
+        if (Quirks::logic_resets_vf) cpu.regs[VF] = 0;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_and(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] &= cpu.regs[instr.y];
+        if (Quirks::logic_resets_vf) cpu.regs[VF] = 0;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_xor(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] ^= cpu.regs[instr.y];
+        if (Quirks::logic_resets_vf) cpu.regs[VF] = 0;
+        return 0;
+    }
+
+    static int op_add_reg(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        u_int8_t reg_pre_addition = cpu.regs[instr.x];
+        cpu.regs[instr.x] += cpu.regs[instr.y];
+        // If, after an addition, the reg is smaller than before, it must have overflown
+        cpu.regs[VF] = (reg_pre_addition > cpu.regs[instr.x]);
+        return 0;
+    }
+
+    static int op_sub(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        bool flag = cpu.regs[instr.x] >= cpu.regs[instr.y];
+        cpu.regs[instr.x] -= cpu.regs[instr.y];
+        cpu.regs[VF] = flag;
+        return 0;
+    }
+
+    static int op_subn(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        bool flag = cpu.regs[instr.y] >= cpu.regs[instr.x];
+        cpu.regs[instr.x] = cpu.regs[instr.y] - cpu.regs[instr.x];
+        cpu.regs[VF] = flag;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_shr(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        u_int8_t value = cpu.regs[Quirks::shift_uses_vy ? instr.y : instr.x];
+        cpu.regs[instr.x] = value >> 1;
+        cpu.regs[VF] = value & 0x01;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_shl(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        u_int8_t value = cpu.regs[Quirks::shift_uses_vy ? instr.y : instr.x];
+        cpu.regs[instr.x] = value << 1;
+        cpu.regs[VF] = value >> 7;
+        return 0;
+    }
+
+    static int op_illegal_alu(Chip8Cpu &, const DecodedInstr &instr) {
+        std::cerr << "Illegal operation " << std::hex << instr.opcode << '\n';
+        return -1;
+    }
+
+    static int op_ld_i(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.I = instr.nnn;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_jp_v0(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.PC = cpu.regs[Quirks::jump_uses_vx ? instr.x : static_cast<u_int8_t>(V0)] + instr.nnn - 0x200;
+        return 0;
+    }
+
+    static int op_rnd(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] = cpu.next_random() & instr.nn;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_drw(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        const u_int8_t *sprite = &cpu.bus.memory->ram[cpu.I];
+        u_int8_t wrapped[2 * 32];
+        // No sprite is longer than two planes of 16x16
+        if (cpu.I > MEMCELL_MAX - sizeof wrapped) {
+            // Sprite data running off the end of memory continues from the start
+            int bytes = cpu.bus.display->sprite_bytes(instr.n);
+            for (int i = 0; i < bytes; i++) {
+                wrapped[i] = cpu.bus.memory->ram[(cpu.I + i) & ADDR_MASK];
+            }
+            sprite = wrapped;
+        }
+        cpu.regs[VF] = cpu.bus.display->draw<Quirks::sprites_wrap>(sprite, cpu.regs[instr.x], cpu.regs[instr.y],
+                instr.n);
+        return 0;
+    }
+
+    // DXY0 without SUPER-CHIP: no rows, so nothing is drawn and nothing collides
+    static int op_drw_none(Chip8Cpu &cpu, const DecodedInstr &) {
+        cpu.regs[VF] = 0;
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_skp(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        // Skip next instruction if key VX is down
+        if (cpu.bus.keypad->key_down(cpu.regs[instr.x])) {
+            skip_next<Quirks>(cpu);
+        }
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_sknp(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        // Skip next instruction if key VX is up
+        if (!cpu.bus.keypad->key_down(cpu.regs[instr.x])) {
+            skip_next<Quirks>(cpu);
+        }
+        return 0;
+    }
+
+    static int op_illegal_key(Chip8Cpu &, const DecodedInstr &) {
+        std::cerr << "Illegal Operation requested\n";
+        return -1;
+    }
+
+    static int op_ld_vx_dt(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.regs[instr.x] = cpu.timers[D];
+        return 0;
+    }
+
+    static int op_ld_dt(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.timers[D] = cpu.regs[instr.x];
+        return 0;
+    }
+
+    static int op_ld_st(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.timers[S] = cpu.regs[instr.x];
+        return 0;
+    }
+
+    static int op_add_i(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.I += cpu.regs[instr.x];
+        return 0;
+    }
+
+    static int op_ld_key(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        u_int8_t key;
+        if (cpu.bus.keypad->poll_key_press(key)) {
+            cpu.regs[instr.x] = key;
+        } else {
+            // Not done waiting; run this instruction again. Keys only change between frames.
+            cpu.PC -= 2;
+            cpu.idle_loop_instrs = 1;
+            cpu.idle_timer_reg = REG_MAX;
+            return EXEC_IDLE;
+        }
+        return 0;
+    }
+
+    static int op_ld_font(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        u_int8_t font = cpu.regs[instr.x];
+        if (font > 0xf) {
+            std::cerr << "Trying to access unknown font\n";
+            return -1;
+        }
+        cpu.I = font_addr(font);
+        return 0;
+    }
+
+    static int op_ld_big_font(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        u_int8_t font = cpu.regs[instr.x];
+        if (font > 0xf) {
+            std::cerr << "Trying to access unknown font\n";
+            return -1;
+        }
+        cpu.I = BIG_FONT_ADDR + 10 * font;
+        return 0;
+    }
+
+    static int op_ld_i_long(Chip8Cpu &cpu, const DecodedInstr &) {
+        // F000 NNNN: the address is the next word, read here rather than at decode time so
+        // self-modifying code sees its changes
+        u_int16_t at = (0x200 + cpu.PC) & ADDR_MASK;
+        cpu.I = (cpu.bus.memory->ram[at] << 8) | cpu.bus.memory->ram[(at + 1) & ADDR_MASK];
+        cpu.PC += 2;
+        return 0;
+    }
+
+    static int op_select_planes(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.bus.display->select_planes(instr.x);
+        return 0;
+    }
+
+    static int op_ld_audio(Chip8Cpu &cpu, const DecodedInstr &) {
+        for (size_t i = 0; i < cpu.audio_pattern.size(); i++) {
+            cpu.audio_pattern[i] = cpu.bus.memory->ram[(cpu.I + i) & ADDR_MASK];
+        }
+        return 0;
+    }
+
+    static int op_ld_pitch(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        cpu.pitch = cpu.regs[instr.x];
+        return 0;
+    }
+
+    static int op_save_flags(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        std::copy_n(cpu.regs.begin(), instr.x + 1, cpu.flag_regs.begin());
+        return 0;
+    }
+
+    static int op_load_flags(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        std::copy_n(cpu.flag_regs.begin(), instr.x + 1, cpu.regs.begin());
+        return 0;
+    }
+
+    static int op_bcd(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        int number = cpu.regs[instr.x];
+        int i = 2;
+        while (i >= 0) {
+            cpu.write_ram(cpu.I + i--, number % 10);
+            number /= 10;
+        }
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_store(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        for (int x = 0; x <= instr.x; x++) {
+            cpu.write_ram(cpu.I + x, cpu.regs[x]);
+        }
+        if (Quirks::index_advance != INDEX_KEEP) {
+            cpu.I += instr.x + (Quirks::index_advance == INDEX_ADD_X_PLUS_1);
+        }
+        return 0;
+    }
+
+    template<class Quirks>
+    static int op_load(Chip8Cpu &cpu, const DecodedInstr &instr) {
+        for (int x = 0; x <= instr.x; x++) {
+            cpu.regs[x] = cpu.bus.memory->ram[(cpu.I + x) & ADDR_MASK];
+        }
+        if (Quirks::index_advance != INDEX_KEEP) {
+            cpu.I += instr.x + (Quirks::index_advance == INDEX_ADD_X_PLUS_1);
+        }
+        return 0;
+    }
+
+    static int op_illegal_misc(Chip8Cpu &, const DecodedInstr &instr) {
+        std::cerr << "Invalid Operation requested: " << std::hex << instr.opcode << '\n';
+        return -1;
+    }
+
+    template<class Quirks>
+    static InstrHandler decode_handler(u_int16_t instruction) {
         switch ((instruction & 0xF000) >> 12) {
             case 0x0:
                 switch (NNN(instruction)) {
-                    case 0xE0:
-                        bus.display->clear();
-                        break;
-                    case 0xEE:
-                        // Return from function call
-                        PC = bus.memory->stack[--SP];
-                        break;
-                    default:
-                        // Ignore; unimplemented machine instructions
-                        break;
+                    case 0xE0: return op_cls;
+                    case 0xEE: return op_ret;
                 }
-                break;
-            case 0x2:
-                bus.memory->stack[SP++] = PC;
-                // Fallthrough here; 0x2NNN requires jumping
-            case 0x1:
-                // Jump to address
-                PC = NNN(instruction) - 0x0200;
-                break;
-            case 0x3:
-                if (regs[REG_X(instruction)] == NN(instruction)) {
-                    PC += 2;
-                }
-                break;
-            case 0x4:
-                if (regs[REG_X(instruction)] != NN(instruction)) {
-                    PC += 2;
+                if (Quirks::schip_opcodes) {
+                    switch (NNN(instruction)) {
+                        case 0xFB: return op_scroll_right;
+                        case 0xFC: return op_scroll_left;
+                        case 0xFD: return op_exit;
+                        case 0xFE: return op_lores;
+                        case 0xFF: return op_hires;
+                    }
+                    if ((NNN(instruction) & 0xFF0) == 0x0C0) return op_scroll_down;
                 }
-                break;
+                if (Quirks::xochip_opcodes && (NNN(instruction) & 0xFF0) == 0x0D0) return op_scroll_up;
+                return op_nop;
+            case 0x1: return op_jp;
+            case 0x2: return op_call;
+            case 0x3: return op_se_imm<Quirks>;
+            case 0x4: return op_sne_imm<Quirks>;
             case 0x5:
-                if (regs[REG_X(instruction)] == regs[REG_Y(instruction)]) {
-                    PC += 2;
-                }
-                break;
-            case 0x9:
-                if (regs[REG_X(instruction)] != regs[REG_Y(instruction)]) {
-                    PC += 2;
+                if (Quirks::xochip_opcodes) {
+                    switch (N(instruction)) {
+                        case 0x2: return op_save_range;
+                        case 0x3: return op_load_range;
+                    }
                 }
-                break;
-            case 0x6:
-                regs[REG_X(instruction)] = NN(instruction);
-                break;
-            case 0x7:
-                regs[REG_X(instruction)] += NN(instruction);
-                break;
+                return op_se_reg<Quirks>;
+            case 0x6: return op_ld_imm;
+            case 0x7: return op_add_imm;
             case 0x8:
-                {
-                    int regx = REG_X(instruction);
-                    int regy = REG_Y(instruction);
-                    switch (instruction & 0x000F) {
-                        case 0x0:
-                            regs[regx] = regs[regy];
-                            break;
-                        case 0x1:
-                            regs[regx] |= regs[regy];
-                            break;
-                        case 0x2:
-                            regs[regx] &= regs[regy];
-                            break;
-                        case 0x3:
-                            regs[regx] ^= regs[regy];
-                            break;
-                        case 0x4:
-                            {
-                                u_int8_t reg_pre_addition = regs[regx];
-                                regs[regx] += regs[regy];
-                                // If, after an addition, the reg is smaller than before, it must have overflown
-                                regs[VF] = (reg_pre_addition > regs[regx]);
-                            }
-                            break;
-                        case 0x5:
-                            {
-                                bool flag = regs[regx] >= regs[regy];
-                                regs[regx] -= regs[regy];
-                                regs[VF] = flag;
-                            }
-                            break;
-                        case 0x7:
-                            {
-                                bool flag = regs[regy] >= regs[regx];
-                                regs[regx] = regs[regy] - regs[regx];
-                                regs[VF] = flag;
-                            }
-                            break;
-                        case 0x6:
-                            {
-                                bool flag = regs[regx] & 0x01;
-                                regs[regx] = regs[regx] >> 1;
-                                regs[VF] = flag;
-                            }
-                            break;
-                        case 0xe:
-                            {
-                                bool flag = regs[regx] & 0x80;
-                                regs[regx] = regs[regx] << 1;
-                                regs[VF] = flag;
-                            }
-                            break;
-                        default:
-                            std::cerr << "Illegal operation " << std::hex << instruction << '\n';
-                            return -1;
-                            break;
-                    }
+                switch (N(instruction)) {
+                    case 0x0: return op_ld_reg;
+                    case 0x1: return op_or<Quirks>;
+                    case 0x2: return op_and<Quirks>;
+                    case 0x3: return op_xor<Quirks>;
+                    case 0x4: return op_add_reg;
+                    case 0x5: return op_sub;
+                    case 0x6: return op_shr<Quirks>;
+                    case 0x7: return op_subn;
+                    case 0xe: return op_shl<Quirks>;
+                    default: return op_illegal_alu;
                 }
-                break;
-            case 0xa:
-                I = NNN(instruction);
-                break;
-            case 0xb:
-                PC = regs[V0] + NNN(instruction) - 0x200;
-                break;
-            case 0xc:
-                regs[REG_X(instruction)] = rand() & NN(instruction);
-                break;
-            case 0xd:
-                regs[VF] = bus.display->draw(&bus.memory->ram[I], regs[REG_X(instruction)],
-                        regs[REG_Y(instruction)], N(instruction)
-                        );
-                break;
+            case 0x9: return op_sne_reg<Quirks>;
+            case 0xa: return op_ld_i;
+            case 0xb: return op_jp_v0<Quirks>;
+            case 0xc: return op_rnd;
+            case 0xd: return N(instruction) == 0 && !Quirks::schip_opcodes ? op_drw_none : op_drw<Quirks>;
             case 0xe:
                 switch (NN(instruction)) {
-                    case 0x9e:
-                        // Skip next instruction if key VX is down
-                        bus.keypad->request_key(regs[REG_X(instruction)], 1);
-                        break;
-                    case 0xa1:
-                        // Skip next instruction if key VX is up
-                        bus.keypad->request_key(regs[REG_X(instruction)], 0);
-                        break;
-                    default:
-                        std::cerr << "Illegal Operation requested\n";
-                        return -1;
+                    case 0x9e: return op_skp<Quirks>;
+                    case 0xa1: return op_sknp<Quirks>;
+                    default: return op_illegal_key;
                 }
-                break;
             case 0xf:
+                if (Quirks::schip_opcodes) {
+                    switch (NN(instruction)) {
+                        case 0x30: return op_ld_big_font;
+                        case 0x75: return op_save_flags;
+                        case 0x85: return op_load_flags;
+                    }
+                }
+                if (Quirks::xochip_opcodes) {
+                    switch (NN(instruction)) {
+                        case 0x01: return op_select_planes;
+                        case 0x02: return instruction == 0xF002 ? op_ld_audio : op_illegal_misc;
+                        case 0x00: return instruction == 0xF000 ? op_ld_i_long : op_illegal_misc;
+                        case 0x3A: return op_ld_pitch;
+                    }
+                }
                 switch (NN(instruction)) {
-                    case 0x07:
-                        regs[REG_X(instruction)] = timers[D];
-                        break;
-                    case 0x15:
-                        timers[D] = regs[REG_X(instruction)];
-                        break;
-                    case 0x18:
-                        timers[S] = regs[REG_X(instruction)];
-                        break;
-                    case 0x1E:
-                        I += regs[REG_X(instruction)];
-                        break;
-                    case 0x0A:
-                        bus.keypad->request_halting_input(&regs[REG_X(instruction)]);
-                        break;
-                    case 0x29:
-                        {
-                            u_int8_t font = regs[REG_X(instruction)];
-                            if (font > 0xf) {
-                                std::cerr << "Trying to access unknown font\n";
-                                return -1;
-                            }
-                            I = font_addr(font);
-                        }
-                        break;
-                    case 0x33:
-                        store_decimal(&bus.memory->ram[I], regs[REG_X(instruction)]);
-                        break;
-                    case 0x55:
-                        for (int x = 0; x <= REG_X(instruction); x++) {
-                            bus.memory->ram[I + x] = regs[x];
-                        }
-                        break;
-                    case 0x65:
-                        for (int x = 0; x <= REG_X(instruction); x++) {
-                            regs[x] = bus.memory->ram[I + x];
-                        }
-                        break;
-                    default:
-                        std::cerr << "Invalid Operation requested: " << std::hex << instruction << '\n';
-                        return -1;
+                    case 0x07: return op_ld_vx_dt;
+                    case 0x15: return op_ld_dt;
+                    case 0x18: return op_ld_st;
+                    case 0x1E: return op_add_i;
+                    case 0x0A: return op_ld_key;
+                    case 0x29: return op_ld_font;
+                    case 0x33: return op_bcd;
+                    case 0x55: return op_store<Quirks>;
+                    case 0x65: return op_load<Quirks>;
+                    default: return op_illegal_misc;
                 }
-                break;
-            default:
-                break;
+        }
+        return op_nop;
+    }
+
+    DecodedInstr decode(u_int16_t instruction, QuirkProfile quirks) {
+        DecodedInstr decoded;
+        switch (quirks) {
+            case QUIRKS_VIP: decoded.handler = decode_handler<VipQuirks>(instruction); break;
+            case QUIRKS_CHIP48: decoded.handler = decode_handler<Chip48Quirks>(instruction); break;
+            case QUIRKS_SCHIP: decoded.handler = decode_handler<SchipQuirks>(instruction); break;
+            case QUIRKS_XOCHIP: decoded.handler = decode_handler<XochipQuirks>(instruction); break;
+            default: decoded.handler = decode_handler<ModernQuirks>(instruction); break;
+        }
+        decoded.opcode = instruction;
+        decoded.nnn = NNN(instruction);
+        decoded.x = REG_X(instruction);
+        decoded.y = REG_Y(instruction);
+        decoded.n = N(instruction);
+        decoded.nn = NN(instruction);
+        return decoded;
+    }
+
+    Chip8Cpu::Chip8Cpu(Memory *memory, Chip8Display *display, Chip8Keypad *keypad) {
+        bus.memory = memory;
+        bus.display = display;
+        bus.keypad = keypad;
+    }
+
+    void Chip8Cpu::seed_random(u_int32_t seed) {
+        // xorshift never leaves a zero state
+        rng_state = seed ? seed : 1;
+    }
+
+    u_int8_t Chip8Cpu::next_random() {
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 17;
+        rng_state ^= rng_state << 5;
+        return rng_state >> 24;
+    }
+
+    void Chip8Cpu::decrement_timers() {
+        if (timers[D]) --timers[D];
+        if (timers[S]) --timers[S];
+    }
+
+    void Chip8Cpu::write_ram(u_int16_t addr, u_int8_t value) {
+        addr &= ADDR_MASK;
+        bus.memory->ram[addr] = value;
+        if (addr >= CACHED_MEMORY) return;
+        // The only cached instruction covering addr starts at the even address at or below it
+        decode_cache[addr >> 1].handler = nullptr;
+        if (!block_coverage.empty() && block_coverage[addr]) {
+            invalidate_blocks(addr);
+        }
+    }
+
+    long Chip8Cpu::skip_idle_loop(long cycles) {
+        long iterations = cycles / idle_loop_instrs;
+        if (iterations && idle_timer_reg != REG_MAX) {
+            // What the skipped FX07s would have loaded
+            regs[idle_timer_reg] = timers[D];
+        }
+        return iterations * idle_loop_instrs;
+    }
+
+    void Chip8Cpu::set_quirks(QuirkProfile profile) {
+        if (profile != quirks) {
+            quirks = profile;
+            invalidate_decode_cache();
+        }
+    }
+
+    void Chip8Cpu::invalidate_decode_cache() {
+        for (DecodedInstr &entry : decode_cache) {
+            entry.handler = nullptr;
+        }
+        for (TranslatedBlock &block : blocks) {
+            if (block.valid) drop_block(block);
+        }
+    }
+
+    inline u_int16_t Chip8Cpu::fetch_instr(u_int16_t addr) {
+        return (bus.memory->ram[addr] << 8) + (bus.memory->ram[(addr + 1) & ADDR_MASK]);
+    }
+
+    template<int Hooks>
+    static inline int run_profiled(Chip8Cpu &cpu, u_int16_t addr, const DecodedInstr &instr) {
+        if (!(Hooks & HOOK_PROFILE)) {
+            return instr.handler(cpu, instr);
+        }
+        cpu.profiler->count_instr(addr, instr.opcode);
+        if ((instr.opcode >> 12) != 0xD) {
+            return instr.handler(cpu, instr);
+        }
+        auto start = Clock::now();
+        int status = instr.handler(cpu, instr);
+        cpu.profiler->add_time(PROFILE_DRAW, Clock::now() - start);
+        return status;
+    }
+
+    template<int Hooks>
+    static inline int run_instr(Chip8Cpu &cpu, u_int16_t addr, const DecodedInstr &instr) {
+        if ((Hooks & HOOK_DEBUG) && cpu.debugger->check(cpu, addr, instr) == EXEC_QUIT) {
+            // The instruction has not run, so PC goes back to it
+            cpu.PC -= 2;
+            return EXEC_QUIT;
+        }
+        if (!(Hooks & HOOK_TRACE)) {
+            return run_profiled<Hooks>(cpu, addr, instr);
+        }
+        int status = run_profiled<Hooks>(cpu, addr, instr);
+        cpu.tracer->record(addr, instr.opcode, status, cpu.regs, cpu.I, cpu.SP);
+        return status;
+    }
+
+    template<int Hooks>
+    int Chip8Cpu::exec_next() {
+        u_int16_t addr = (0x200 + PC) & ADDR_MASK;
+        PC += 2;
+        if ((addr & 1) || addr >= CACHED_MEMORY) {
+            // Odd addresses are rare enough to decode on every visit, and code above the cached memory only
+            // exists in XO-CHIP programs
+            DecodedInstr decoded = decode(fetch_instr(addr), quirks);
+            return run_instr<Hooks>(*this, addr, decoded);
+        }
+        DecodedInstr &entry = decode_cache[addr >> 1];
+        if (entry.handler == nullptr) {
+            entry = decode(fetch_instr(addr), quirks);
+        }
+        return run_instr<Hooks>(*this, addr, entry);
+    }
+
+    // Instructions after which control may not simply fall through to the next address.
+    // Judged by opcode since several of these handlers have one instantiation per quirk profile.
+    static bool ends_block(const DecodedInstr &instr) {
+        switch (instr.opcode >> 12) {
+            case 0x0: return instr.opcode == 0x00EE || instr.opcode == 0x00FD;
+            case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x9: case 0xb: case 0xe:
+                return true;
+            case 0x8: return instr.handler == op_illegal_alu;
+            case 0xf:
+                // FX33 and FX55 may overwrite the block that is running; F000 steps over its operand
+                return instr.nn == 0x0A || instr.nn == 0x33 || instr.nn == 0x55 || instr.opcode == 0xF000
+                    || instr.handler == op_illegal_misc;
+            default: return false;
+        }
+    }
+
+    TranslatedBlock *Chip8Cpu::translate(u_int16_t addr) {
+        TranslatedBlock &block = blocks[addr];
+        block.instrs.clear();
+        block.start = addr;
+        block.successor = nullptr;
+        u_int16_t at = addr;
+        while (block.instrs.size() < BLOCK_MAX_INSTRS && at + 2 <= CACHED_MEMORY) {
+            DecodedInstr decoded = decode(fetch_instr(at), quirks);
+            block.instrs.push_back(decoded);
+            at += 2;
+            if (ends_block(decoded)) break;
+        }
+        block.end = at;
+        for (u_int16_t covered = block.start; covered < block.end; covered++) {
+            ++block_coverage[covered];
+        }
+        block.valid = true;
+        return &block;
+    }
+
+    void Chip8Cpu::drop_block(TranslatedBlock &block) {
+        block.valid = false;
+        for (u_int16_t covered = block.start; covered < block.end; covered++) {
+            --block_coverage[covered];
+        }
+    }
+
+    void Chip8Cpu::invalidate_blocks(u_int16_t addr) {
+        // Blocks are bounded in length, so only starts within that distance can cover addr
+        int lowest_start = std::max(0, addr - 2 * BLOCK_MAX_INSTRS);
+        for (int start = addr; start >= lowest_start; start--) {
+            TranslatedBlock &block = blocks[start];
+            if (block.valid && block.end > addr) {
+                drop_block(block);
+            }
+        }
+    }
+
+    template<int Hooks>
+    int Chip8Cpu::exec_blocks(long max_cycles, long &executed) {
+        if (blocks.empty()) {
+            blocks.resize(CACHED_MEMORY);
+            block_coverage.assign(CACHED_MEMORY, 0);
+        }
+        executed = 0;
+        TranslatedBlock *block = nullptr;
+        while (executed < max_cycles) {
+            u_int16_t addr = (0x200 + PC) & ADDR_MASK;
+            if (addr >= CACHED_MEMORY - 1) {
+                // Code beyond the cached memory, or straddling its end, is left to the interpreter
+                ++executed;
+                return exec_next<Hooks>();
+            }
+            TranslatedBlock *next;
+            if (block && block->successor && block->successor->valid && block->successor->start == addr) {
+                next = block->successor;
+            } else {
+                next = blocks[addr].valid ? &blocks[addr] : translate(addr);
+                if (block) block->successor = next;
+            }
+            block = next;
+            long count = std::min<long>(block->instrs.size(), max_cycles - executed);
+            for (long i = 0; i < count; i++) {
+                const DecodedInstr &instr = block->instrs[i];
+                PC += 2;
+                ++executed;
+                int status = run_instr<Hooks>(*this, block->start + 2 * i, instr);
+                if (status != EXEC_OK) return status;
+            }
         }
         return 0;
     }
 
+    #define INSTANTIATE_HOOKS(Hooks) \
+        template int Chip8Cpu::exec_next<Hooks>(); \
+        template int Chip8Cpu::exec_blocks<Hooks>(long, long &);
+
+    INSTANTIATE_HOOKS(HOOK_NONE)
+    INSTANTIATE_HOOKS(HOOK_PROFILE)
+    INSTANTIATE_HOOKS(HOOK_TRACE)
+    INSTANTIATE_HOOKS(HOOK_PROFILE | HOOK_TRACE)
+    INSTANTIATE_HOOKS(HOOK_DEBUG)
+    INSTANTIATE_HOOKS(HOOK_DEBUG | HOOK_PROFILE)
+    INSTANTIATE_HOOKS(HOOK_DEBUG | HOOK_TRACE)
+    INSTANTIATE_HOOKS(HOOK_ALL)
+
 }
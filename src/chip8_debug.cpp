@@ -0,0 +1,235 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DEBUG_ADDR_MASK (MEMCELL_MAX - 1)
+// Bytes per line of a memory dump
+#define DEBUG_DUMP_WIDTH 16
+
+enum WatchKind {
+    WATCH_READ = 1, WATCH_WRITE = 2
+};
+
+static const char DEBUG_HELP[] =
+    "c                 continue\n"
+    "s [N]             run N instructions (default 1), then stop\n"
+    "b ADDR            break before the instruction at ADDR\n"
+    "bd ADDR           delete the breakpoint at ADDR\n"
+    "w ADDR [LEN]      stop before instructions that write RAM in ADDR..ADDR+LEN-1\n"
+    "r ADDR [LEN]      stop before instructions that read RAM in ADDR..ADDR+LEN-1\n"
+    "wd ADDR [LEN]     delete read and write watchpoints in the range\n"
+    "l                 list breakpoints and watchpoints\n"
+    "regs              show registers and timers\n"
+    "stack             show the call stack\n"
+    "m ADDR [LEN]      dump LEN bytes of RAM (default 16)\n"
+    "q                 end the run\n"
+    "Addresses, lengths and counts are hex.\n";
+
+namespace chip8 {
+
+    Debugger::~Debugger() {
+        if (client >= 0) {
+            fclose(in);
+            fclose(out);
+        }
+    }
+
+    int Debugger::open(std::string socket_path) {
+        if (socket_path.empty()) {
+            return 0;
+        }
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof address.sun_path) {
+            std::cerr << "Debugger socket path is too long: " << socket_path << '\n';
+            return -1;
+        }
+        socket_path.copy(address.sun_path, socket_path.size());
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path.c_str());
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof address) != 0
+                || listen(listener, 1) != 0) {
+            std::cerr << "Could not listen on " << socket_path << '\n';
+            if (listener >= 0) close(listener);
+            return -1;
+        }
+        std::cerr << "Waiting for a debugger client on " << socket_path << '\n';
+        client = accept(listener, NULL, NULL);
+        close(listener);
+        unlink(socket_path.c_str());
+        if (client < 0) {
+            std::cerr << "Could not accept a debugger client\n";
+            return -1;
+        }
+        // Separate streams for each direction, so closing one does not close the descriptor under the other
+        in = fdopen(client, "r");
+        out = fdopen(dup(client), "w");
+        return 0;
+    }
+
+    bool Debugger::memory_access(const Chip8Cpu &cpu, const DecodedInstr &instr, u_int16_t &start, int &length,
+            bool &writes) const {
+        start = cpu.I;
+        switch (instr.opcode >> 12) {
+            case 0x5:
+                if (instr.n != 2 && instr.n != 3) return false;
+                length = std::abs(instr.x - instr.y) + 1;
+                writes = instr.n == 2;
+                return true;
+            case 0xd:
+                length = cpu.bus.display->sprite_bytes(instr.n);
+                writes = false;
+                return true;
+            case 0xf:
+                switch (instr.nn) {
+                    case 0x02: length = 16; writes = false; return instr.opcode == 0xF002;
+                    case 0x33: length = 3; writes = true; return true;
+                    case 0x55: length = instr.x + 1; writes = true; return true;
+                    case 0x65: length = instr.x + 1; writes = false; return true;
+                }
+                return false;
+        }
+        return false;
+    }
+
+    bool Debugger::accesses_watched(const Chip8Cpu &cpu, const DecodedInstr &instr) const {
+        u_int16_t start;
+        int length;
+        bool writes;
+        if (!memory_access(cpu, instr, start, length, writes)) return false;
+        const std::bitset<MEMCELL_MAX> &watches = writes ? write_watches : read_watches;
+        for (int i = 0; i < length; i++) {
+            if (watches[(start + i) & DEBUG_ADDR_MASK]) return true;
+        }
+        return false;
+    }
+
+    void Debugger::set_watch(u_int16_t start, int length, int kinds, bool on) {
+        for (int i = 0; i < length; i++) {
+            u_int16_t addr = (start + i) & DEBUG_ADDR_MASK;
+            if (kinds & WATCH_READ) read_watches[addr] = on;
+            if (kinds & WATCH_WRITE) write_watches[addr] = on;
+        }
+        watching = read_watches.any() || write_watches.any();
+    }
+
+    void Debugger::print_registers(const Chip8Cpu &cpu, u_int16_t addr) const {
+        std::ostringstream text;
+        text << std::hex << std::uppercase;
+        for (int reg = 0; reg < REG_MAX; reg++) {
+            text << 'V' << reg << '=' << (cpu.regs[reg] < 0x10 ? "0" : "") << +cpu.regs[reg]
+                << (reg % 8 == 7 ? '\n' : ' ');
+        }
+        text << "PC=" << addr << " I=" << cpu.I << " SP=" << +cpu.SP << std::dec
+            << " DT=" << +cpu.timers[D] << " ST=" << +cpu.timers[S] << '\n';
+        fputs(text.str().c_str(), out);
+    }
+
+    void Debugger::print_stack(const Chip8Cpu &cpu) const {
+        if (cpu.SP == 0) {
+            fputs("Stack is empty\n", out);
+            return;
+        }
+        // Innermost call first; entries are return addresses
+        for (int level = cpu.SP - 1; level >= 0; level--) {
+            fprintf(out, "#%d %03X\n", cpu.SP - 1 - level, (0x200 + cpu.bus.memory->stack[level]) & DEBUG_ADDR_MASK);
+        }
+    }
+
+    void Debugger::print_memory(const Chip8Cpu &cpu, u_int16_t start, int length) const {
+        for (int i = 0; i < length; i++) {
+            u_int16_t addr = (start + i) & DEBUG_ADDR_MASK;
+            if (i % DEBUG_DUMP_WIDTH == 0) fprintf(out, "%s%04X:", i ? "\n" : "", addr);
+            fprintf(out, " %02X", cpu.bus.memory->ram[addr]);
+        }
+        fputc('\n', out);
+    }
+
+    void Debugger::print_points() const {
+        for (size_t addr = 0; addr < MEMCELL_MAX; addr++) {
+            if (breakpoints[addr]) fprintf(out, "break %04zX\n", addr);
+        }
+        // Watched ranges are listed as runs of consecutive addresses
+        const std::bitset<MEMCELL_MAX> *watches[] = {&read_watches, &write_watches};
+        for (int kind = 0; kind < 2; kind++) {
+            for (size_t addr = 0; addr < MEMCELL_MAX; addr++) {
+                if (!(*watches[kind])[addr]) continue;
+                size_t end = addr;
+                while (end + 1 < MEMCELL_MAX && (*watches[kind])[end + 1]) end++;
+                fprintf(out, "watch %s %04zX-%04zX\n", kind ? "write" : "read", addr, end);
+                addr = end;
+            }
+        }
+    }
+
+    void Debugger::detach() {
+        breakpoints.reset();
+        read_watches.reset();
+        write_watches.reset();
+        watching = false;
+        steps = 0;
+    }
+
+    int Debugger::stop(Chip8Cpu &cpu, u_int16_t addr, const DecodedInstr &instr) {
+        steps = 0;
+        u_int16_t start;
+        int length;
+        bool writes;
+        if (breakpoints[addr]) {
+            fprintf(out, "Breakpoint at %03X\n", addr);
+        } else if (watching && accesses_watched(cpu, instr) && memory_access(cpu, instr, start, length, writes)) {
+            fprintf(out, "Watchpoint: %s of %d bytes at %03X\n", writes ? "write" : "read", length, start);
+        }
+        fprintf(out, "%03X: %04X\n", addr, instr.opcode);
+        char line[256];
+        for (;;) {
+            fputs("(chip8) ", out);
+            fflush(out);
+            if (fgets(line, sizeof line, in) == NULL) {
+                detach();
+                return EXEC_OK;
+            }
+            std::istringstream args(line);
+            std::string command;
+            unsigned long first = 0, second = 0;
+            args >> command >> std::hex >> first;
+            bool has_first = !args.fail();
+            if (!(args >> second)) second = 0;
+            if (command.empty()) {
+                continue;
+            } else if (command == "c") {
+                return EXEC_OK;
+            } else if (command == "s") {
+                steps = has_first && first ? first : 1;
+                return EXEC_OK;
+            } else if (command == "q") {
+                return EXEC_QUIT;
+            } else if (command == "regs") {
+                print_registers(cpu, addr);
+            } else if (command == "stack") {
+                print_stack(cpu);
+            } else if (command == "l") {
+                print_points();
+            } else if (command == "h" || command == "help") {
+                fputs(DEBUG_HELP, out);
+            } else if (!has_first || first >= MEMCELL_MAX) {
+                fprintf(out, "Unknown command or missing address; h lists the commands\n");
+            } else if (command == "b") {
+                breakpoints[first] = true;
+            } else if (command == "bd") {
+                breakpoints[first] = false;
+            } else if (command == "w" || command == "r" || command == "wd") {
+                int kinds = command == "w" ? WATCH_WRITE : command == "r" ? WATCH_READ : WATCH_READ | WATCH_WRITE;
+                set_watch(first, second ? std::min(second, (unsigned long) MEMCELL_MAX) : 1, kinds, command != "wd");
+            } else if (command == "m") {
+                print_memory(cpu, first, second ? std::min(second, (unsigned long) MEMCELL_MAX) : DEBUG_DUMP_WIDTH);
+            } else {
+                fprintf(out, "Unknown command: %s\n", command.c_str());
+            }
+        }
+    }
+
+}
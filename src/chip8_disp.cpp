@@ -1,72 +1,169 @@
 #include "chip8.hpp"
 #include <iostream>
+#include <algorithm>
+
+// Pixels of a low resolution row; the rest of the row is always clear
+static const chip8::PixelRow LORES_ROW = ~static_cast<chip8::PixelRow>(0) << (SCREEN_WIDTH - LORES_WIDTH);
+
+// Place a sprite row of width bits so that its leftmost pixel lands on column x of a screen
+// screen_width wide. Pixels past the right edge fall off, or come back in on the left with Wrap.
+template<bool Wrap>
+inline chip8::PixelRow place_sprite_row(unsigned bits, int width, int x, int screen_width) {
+    chip8::PixelRow row = static_cast<chip8::PixelRow>(bits) << (SCREEN_WIDTH - width);
+    chip8::PixelRow placed = row >> x;
+    if (screen_width < SCREEN_WIDTH) {
+        chip8::PixelRow spill = placed & ~LORES_ROW;
+        placed ^= spill;
+        if (Wrap) placed |= spill << LORES_WIDTH;
+    } else if (Wrap && x > SCREEN_WIDTH - width) {
+        placed |= row << (SCREEN_WIDTH - x);
+    }
+    return placed;
+}
 
 namespace chip8 {
 
+    // Indexed by pixel value, whose bit N comes from plane N
+    const Palette DEFAULT_PALETTE = {0xFF000000, 0xFFFFFFFF, 0xFFAA5500, 0xFF555555};
+
     Chip8Display::~Chip8Display() {
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
+        delete headless;
     }
 
-    int Chip8Display::init(std::string program, const short scaling_factor) {
-        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-            std::cerr << "Failed to initialize SDL: " << SDL_GetError() << '\n';
-            return -1;
-        }
-        window = SDL_CreateWindow(program.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                (scaling_factor * REAL_WIDTH), (scaling_factor * REAL_HEIGHT), SDL_WINDOW_SHOWN);
-        if (window == NULL) {
-            std::cerr << "Failed to create window: " << SDL_GetError() << '\n';
-            return -1;
+    void Chip8Display::init(DisplayBackend *backend) {
+        if (backend == nullptr) {
+            if (headless == nullptr) headless = new HeadlessDisplayBackend();
+            backend = headless;
         }
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-        SDL_RenderSetLogicalSize(renderer, REAL_WIDTH, REAL_HEIGHT);
-        render_screen();
-        return 0;
+        this->backend = backend;
+        dirty = true;
+        present();
     }
 
     void Chip8Display::clear() {
-        for (size_t i = 0; i < REAL_HEIGHT; i++) {
-            for (size_t j = 0; j < REAL_WIDTH; j++) {
-                pixels_on_screen[i][j] = 0;
+        for (int plane = 0; plane < PLANES; plane++) {
+            if (plane_mask & (1 << plane)) planes[plane].fill(0);
+        }
+        dirty = true;
+    }
+
+    void Chip8Display::set_hires(bool enabled) {
+        high_resolution = enabled;
+        for (Plane &plane : planes) {
+            plane.fill(0);
+        }
+        dirty = true;
+    }
+
+    void Chip8Display::scroll_down(int pixels) {
+        int height = high_resolution ? SCREEN_HEIGHT : LORES_HEIGHT;
+        pixels = std::min(pixels, height);
+        for (int plane = 0; plane < PLANES; plane++) {
+            if (!(plane_mask & (1 << plane))) continue;
+            Plane &rows = planes[plane];
+            std::copy_backward(rows.begin(), rows.begin() + height - pixels, rows.begin() + height);
+            std::fill(rows.begin(), rows.begin() + pixels, 0);
+        }
+        dirty = true;
+    }
+
+    void Chip8Display::scroll_up(int pixels) {
+        int height = high_resolution ? SCREEN_HEIGHT : LORES_HEIGHT;
+        pixels = std::min(pixels, height);
+        for (int plane = 0; plane < PLANES; plane++) {
+            if (!(plane_mask & (1 << plane))) continue;
+            Plane &rows = planes[plane];
+            std::copy(rows.begin() + pixels, rows.begin() + height, rows.begin());
+            std::fill(rows.begin() + height - pixels, rows.begin() + height, 0);
+        }
+        dirty = true;
+    }
+
+    void Chip8Display::scroll_right(int pixels) {
+        // Shifting right moves pixels off the edge of a high resolution row, but into the unused half of a
+        // low resolution one
+        PixelRow visible = high_resolution ? ~static_cast<PixelRow>(0) : LORES_ROW;
+        for (int plane = 0; plane < PLANES; plane++) {
+            if (!(plane_mask & (1 << plane))) continue;
+            for (PixelRow &row : planes[plane]) {
+                row = (row >> pixels) & visible;
             }
         }
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
-        SDL_RenderClear(renderer);
+        dirty = true;
     }
 
-    void Chip8Display::render_screen() {
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-        SDL_RenderClear(renderer);
-        for (int i = 0; i < REAL_HEIGHT; ++i) {
-            for (int j = 0; j < REAL_WIDTH; j++) {
-                if (pixels_on_screen[i][j]) {
-                    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-                    SDL_RenderDrawPoint(renderer, j, i);
-                }
+    void Chip8Display::scroll_left(int pixels) {
+        for (int plane = 0; plane < PLANES; plane++) {
+            if (!(plane_mask & (1 << plane))) continue;
+            for (PixelRow &row : planes[plane]) {
+                row <<= pixels;
             }
         }
-        SDL_RenderPresent(renderer);
+        dirty = true;
     }
 
-    bool Chip8Display::draw(u_int8_t *sprite_base_addr, int X, int Y, int rows) {
-        bool bit_turned_off = false;
-        int y = Y % 32;
-        for (int row = 0; row < rows; row++) {
-            int x = X % 64;
-            for (int col = 0; col < 8; col++) {
-                bool pixel_in_sprite = ((sprite_base_addr[row] >> (7 - col)) & 1);
-                bit_turned_off |= (pixel_in_sprite & pixels_on_screen[y][x]);
-                pixels_on_screen[y][x] ^= pixel_in_sprite;
-                if (x == 63) break;
-                ++x;
+    void Chip8Display::set_palette(const Palette &palette) {
+        backend->set_palette(palette);
+        dirty = true;
+    }
+
+    void Chip8Display::present() {
+        if (!dirty && !backend->animating()) return;
+        backend->render(planes, high_resolution);
+        dirty = false;
+    }
+
+    int Chip8Display::sprite_bytes(int rows) const {
+        int per_plane = rows ? rows : 32;
+        return per_plane * __builtin_popcount(plane_mask);
+    }
+
+    template<bool Wrap>
+    bool Chip8Display::draw(const u_int8_t *sprite_base_addr, int X, int Y, int sprite_rows) {
+        const int width = high_resolution ? SCREEN_WIDTH : LORES_WIDTH;
+        const int height = high_resolution ? SCREEN_HEIGHT : LORES_HEIGHT;
+        // Both are powers of two
+        int x = X & (width - 1);
+        int y = Y & (height - 1);
+        dirty = true;
+        // Sprites wrap at their origin; past the bottom edge they are clipped unless Wrap
+        if (sprite_rows && plane_mask == 1 && x <= 64 - 8) {
+            // The common case of a plain CHIP-8 sprite on one plane that lands in the left half of the rows,
+            // so all the work is on the upper 64 bit words
+            int visible_rows = Wrap ? sprite_rows : std::min(sprite_rows, height - y);
+            Plane &rows = planes[0];
+            uint64_t collided = 0;
+            for (int row = 0; row < visible_rows; row++) {
+                PixelRow placed = static_cast<PixelRow>(static_cast<uint64_t>(sprite_base_addr[row]) << (56 - x)) << 64;
+                PixelRow &screen = rows[Wrap ? (y + row) & (height - 1) : y + row];
+                collided |= static_cast<uint64_t>((screen & placed) >> 64);
+                screen ^= placed;
             }
-            if (y == 31) break;
-            ++y;
+            return collided != 0;
         }
-        render_screen();
-        return bit_turned_off;
+        // DXY0 draws 16x16 sprites, two bytes per row
+        const bool wide = (sprite_rows == 0);
+        if (wide) sprite_rows = 16;
+        const int sprite_width = wide ? 16 : 8;
+        int visible_rows = Wrap ? sprite_rows : std::min(sprite_rows, height - y);
+        PixelRow collided = 0;
+        const u_int8_t *sprite = sprite_base_addr;
+        for (int plane = 0; plane < PLANES; plane++) {
+            if (!(plane_mask & (1 << plane))) continue;
+            Plane &rows = planes[plane];
+            for (int row = 0; row < visible_rows; row++) {
+                unsigned bits = wide ? (sprite[2 * row] << 8) | sprite[2 * row + 1] : sprite[row];
+                PixelRow placed = place_sprite_row<Wrap>(bits, sprite_width, x, width);
+                PixelRow &screen = rows[Wrap ? (y + row) & (height - 1) : y + row];
+                collided |= screen & placed;
+                screen ^= placed;
+            }
+            sprite += wide ? 32 : sprite_rows;
+        }
+        return collided != 0;
     }
 
+    template bool Chip8Display::draw<false>(const u_int8_t *, int, int, int);
+    template bool Chip8Display::draw<true>(const u_int8_t *, int, int, int);
+
 }
@@ -0,0 +1,11 @@
+#include "chip8.hpp"
+
+namespace chip8 {
+
+    void HeadlessDisplayBackend::render(const Framebuffer &frame, bool high_resolution) {
+        framebuffer = frame;
+        hires = high_resolution;
+        ++frames_rendered;
+    }
+
+}
@@ -0,0 +1,55 @@
+#include "chip8_sdl.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace chip8 {
+
+    SdlDisplayBackend::~SdlDisplayBackend() {
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+
+    int SdlDisplayBackend::init(std::string title, const short scaling_factor, double persistence) {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            std::cerr << "Failed to initialize SDL: " << SDL_GetError() << '\n';
+            return -1;
+        }
+        // The output is always high resolution; low resolution pixels are drawn as 2x2 blocks. Odd factors scale
+        // to the even size below, at least 1, and the GPU stretches that up to the window with nearest sampling.
+        // Every low resolution pixel still gets exactly scaling_factor window pixels, while high resolution ones,
+        // half a low resolution pixel wide, alternate between the two sizes around it; only even factors avoid
+        // that. Stretching up keeps the texture no larger than the window, except at factor 1, where high
+        // resolution needs twice the window and the GPU shrinks it.
+        scaler.configure(std::max(scaling_factor / 2, 1), persistence);
+        window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                (scaling_factor * LORES_WIDTH), (scaling_factor * LORES_HEIGHT), SDL_WINDOW_SHOWN);
+        if (window == NULL) {
+            std::cerr << "Failed to create window: " << SDL_GetError() << '\n';
+            return -1;
+        }
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        if (renderer == NULL) {
+            std::cerr << "Failed to create renderer: " << SDL_GetError() << '\n';
+            return -1;
+        }
+        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                scaler.width(), scaler.height());
+        if (texture == NULL) {
+            std::cerr << "Failed to create texture: " << SDL_GetError() << '\n';
+            return -1;
+        }
+        return 0;
+    }
+
+    void SdlDisplayBackend::render(const Framebuffer &framebuffer, bool hires) {
+        const uint32_t *pixels = scaler.render(framebuffer, hires);
+        SDL_UpdateTexture(texture, NULL, pixels, scaler.width() * sizeof(Uint32));
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+    }
+
+}
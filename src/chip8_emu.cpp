@@ -1,9 +1,18 @@
 #include "chip8.hpp"
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define arrlen(arr) (sizeof arr / sizeof arr[0])
 
+// Upper bound on rewind history memory; a typical frame delta is a few dozen bytes
+#define REWIND_CAPACITY (8 << 20)
+#define REWIND_KEYFRAME_INTERVAL 60
+
 uint8_t FONT_DATA[] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0,   // 0
     0x20, 0x60, 0x20, 0x20, 0x70,   // 1
@@ -23,14 +32,24 @@ uint8_t FONT_DATA[] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80    // F
 };
 
-inline size_t filesize(const char *file_name) {
-    FILE *file = fopen(file_name, "rb");
-    if (file == NULL) return 0;
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    fclose(file);
-    return size;
-}
+uint8_t BIG_FONT_DATA[] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C,   // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C,   // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF,   // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C,   // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06,   // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C,   // 5
+    0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C,   // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60,   // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C,   // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C,   // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,   // A
+    0xFE, 0xFF, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xC3, 0xFF, 0xFE,   // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,   // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,   // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,   // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0    // F
+};
 
 namespace chip8 {
 
@@ -39,9 +58,39 @@ namespace chip8 {
         keypad = new Chip8Keypad();
         memory = new Memory;
         cpu = new Chip8Cpu(memory, display, keypad);
+        // Headless until a run picks a backend, so a machine is usable however it is driven
+        display->init();
+        reset();
+    }
+
+    void Chip8Emu::reset() {
+        MachineState state = {};
+        state.magic = STATE_MAGIC;
+        state.version = STATE_VERSION;
         for (size_t i = 0; i < arrlen(FONT_DATA); i++) {
-            memory->ram[i] = FONT_DATA[i];
+            state.ram[i] = FONT_DATA[i];
+        }
+        for (size_t i = 0; i < arrlen(BIG_FONT_DATA); i++) {
+            state.ram[BIG_FONT_ADDR + i] = BIG_FONT_DATA[i];
         }
+        // What the CPU and display start with; the generator is seeded again by every run
+        state.rng_state = 1;
+        state.pitch = 64;
+        state.plane_mask = 1;
+        load_state(state);
+        keypad->set_keys(0);
+    }
+
+    void Chip8Emu::detach_hooks() {
+        delete profiler;
+        profiler = nullptr;
+        cpu->profiler = nullptr;
+        delete debugger;
+        debugger = nullptr;
+        cpu->debugger = nullptr;
+        delete tracer;
+        tracer = nullptr;
+        cpu->tracer = nullptr;
     }
 
     Chip8Emu::~Chip8Emu() {
@@ -49,56 +98,455 @@ namespace chip8 {
         delete cpu;
         delete keypad;
         delete memory;
+        delete rewind_buffer;
+        delete profiler;
+        delete video;
+        delete tracer;
+        delete debugger;
     }
 
     int Chip8Emu::load_program() {
-        FILE *source = fopen(runnig_program.c_str(), "rb");
-        if (source == NULL) {
-            std::cerr << "Could not open file\n";
-            std::cerr << errno << '\n';
+        int fd = open(runnig_program.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Could not open " << runnig_program << '\n';
             return -1;
         }
-        size_t size = filesize(runnig_program.c_str());
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            std::cerr << "Empty program source\n";
+            close(fd);
+            return -1;
+        }
+        void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Could not map " << runnig_program << '\n';
+            return -1;
+        }
+        int status = load_rom(static_cast<const u_int8_t *>(mapping), info.st_size);
+        munmap(mapping, info.st_size);
+        return status;
+    }
+
+    int Chip8Emu::load_rom(const u_int8_t *rom, size_t size, uint64_t hash) {
         if (size == 0) {
             std::cerr << "Empty program source\n";
             return -1;
         }
-        fread(&memory->ram[0x200], sizeof(u_int8_t), size, source);
-        fclose(source);
+        if (size > MEMCELL_MAX - 0x200) {
+            std::cerr << "Program does not fit in memory\n";
+            return -1;
+        }
+        // Nothing of a program loaded before, or of the state it left, carries over
+        reset();
+        std::memcpy(&memory->ram[0x200], rom, size);
+        program_hash = hash ? hash : hash_bytes(rom, size);
+        cpu->invalidate_decode_cache();
         return 0;
     }
 
-    int Chip8Emu::run_program(std::string program, const short display_scaling_factor, const short cpu_freq) {
-        const double FRAMEDELAY = 1000 / cpu_freq;
+    bool Chip8Emu::same_state(const Chip8Emu &other) const {
+        return cpu->regs == other.cpu->regs && cpu->PC == other.cpu->PC && cpu->I == other.cpu->I
+            && cpu->SP == other.cpu->SP && cpu->timers == other.cpu->timers
+            && memory->ram == other.memory->ram && memory->stack == other.memory->stack
+            && display->framebuffer() == other.display->framebuffer() && display->hires() == other.display->hires();
+    }
+
+    template<int Hooks>
+    int Chip8Emu::run_cycles(long cycles, long &executed) {
+        executed = 0;
+        int status = EXEC_OK;
+        while (executed < cycles) {
+            if (Hooks & HOOK_TRACE) {
+                // Skipped idle cycles leave gaps, so the count is resynchronized on every entry
+                tracer->cycle = cycles_executed + executed;
+            }
+            if (engine == ENGINE_BLOCKS) {
+                long ran;
+                status = cpu->exec_blocks<Hooks>(cycles - executed, ran);
+                executed += ran;
+            } else {
+                status = cpu->exec_next<Hooks>();
+                ++executed;
+            }
+            if (status < 0) {
+                std::cerr << "Error in execution stage\n";
+                return EXEC_ERROR;
+            }
+            if (status == EXEC_QUIT) {
+                // The instruction the debugger stopped at was counted but never ran
+                --executed;
+                return EXEC_QUIT;
+            }
+            if (status == EXEC_HALTED && stop_on_halt) {
+                return EXEC_HALTED;
+            }
+            if (status == EXEC_HALTED && skip_idle) {
+                // Every jump to itself until the end of the frame is the same
+                executed = cycles;
+                frame_idle = true;
+            } else if (status == EXEC_IDLE && skip_idle) {
+                executed += cpu->skip_idle_loop(cycles - executed);
+                frame_idle = true;
+            }
+        }
+        return EXEC_OK;
+    }
+
+    int Chip8Emu::run_hooked(long cycles, long &executed) {
+        // One instantiation of the loop per combination of hooks, indexed by the ExecHooks mask
+        static int (Chip8Emu::*const run_instantiation[HOOK_ALL + 1])(long, long &) = {
+            &Chip8Emu::run_cycles<0>, &Chip8Emu::run_cycles<1>, &Chip8Emu::run_cycles<2>, &Chip8Emu::run_cycles<3>,
+            &Chip8Emu::run_cycles<4>, &Chip8Emu::run_cycles<5>, &Chip8Emu::run_cycles<6>, &Chip8Emu::run_cycles<7>
+        };
+        int hooks = (profiler ? HOOK_PROFILE : HOOK_NONE) | (tracer ? HOOK_TRACE : HOOK_NONE)
+            | (debugger ? HOOK_DEBUG : HOOK_NONE);
+        return (this->*run_instantiation[hooks])(cycles, executed);
+    }
+
+    int Chip8Emu::run_frame(double cycles_per_frame, unsigned long cycle_limit, u_int16_t keys) {
+        // Carry the fractional part over so the long run rate matches exactly
+        cycle_carry += cycles_per_frame;
+        long cycles = static_cast<long>(cycle_carry);
+        cycle_carry -= cycles;
+        // A limit landing exactly on the end of the frame still lets it tick the timers, as stepping does
+        bool limit_reached = false, frame_cut = false;
+        if (cycle_limit && cycles_executed + cycles >= cycle_limit) {
+            frame_cut = cycles_executed + cycles > cycle_limit;
+            cycles = cycle_limit - cycles_executed;
+            limit_reached = true;
+        }
+        long executed;
+        keypad->set_keys(keys);
+        frame_idle = false;
+        int status = run_hooked(cycles, executed);
+        if (status < 0) {
+            return -1;
+        }
+        cycles_executed += executed;
+        if (status == EXEC_HALTED) {
+            program_halted = true;
+            display->present();
+            return 1;
+        }
+        if (status == EXEC_QUIT || frame_cut) {
+            display->present();
+            return 1;
+        }
+        cpu->decrement_timers();
+        display->present();
+        return limit_reached ? 1 : 0;
+    }
+
+    int Chip8Emu::run_program(std::string program, const EmuOptions &options) {
         runnig_program = program;
-        display->init(runnig_program, display_scaling_factor);
+        display->init(options.frontend ? options.frontend->display_backend() : nullptr);
         if (load_program() != 0) {
             std::cerr << "Error while loading program to memory\n";
             return -1;
         }
-        const Uint8 *kbstate = SDL_GetKeyboardState(NULL);
-        SDL_Event event;
-        bool running = true;
-        int frame_time;
-        while (running) {
-            int frame_start = SDL_GetTicks();
-            if (cpu->exec_next() != 0) {
-                std::cerr << "Error in execution stage\n";
+        cpu->seed_random(options.seed);
+        state_path = options.state_file.empty() ? program + ".state" : options.state_file;
+        if (options.resume_from_state && load_state_file(state_path) != 0) {
+            std::cerr << "Error while loading save state\n";
+            return -1;
+        }
+        return run_loaded(options);
+    }
+
+    int Chip8Emu::run_rom(const u_int8_t *rom, size_t size, const EmuOptions &options, uint64_t hash) {
+        runnig_program = "CHIP-8";
+        display->init(options.frontend ? options.frontend->display_backend() : nullptr);
+        if (load_rom(rom, size, hash) != 0) {
+            std::cerr << "Error while loading program to memory\n";
+            return -1;
+        }
+        cpu->seed_random(options.seed);
+        return run_loaded(options);
+    }
+
+    int Chip8Emu::load(const u_int8_t *rom, size_t size, const EmuOptions &options) {
+        runnig_program = "CHIP-8";
+        loaded = false;
+        display->init();
+        detach_hooks();
+        if (load_rom(rom, size) != 0) {
+            return -1;
+        }
+        cpu->seed_random(options.seed);
+        cpu->set_quirks(options.quirks);
+        engine = options.engine;
+        stop_on_halt = options.stop_on_halt;
+        skip_idle = options.skip_idle;
+        program_halted = false;
+        step_cycles_per_frame = options.cycles_per_frame ?
+            options.cycles_per_frame : static_cast<double>(options.cpu_freq) / FRAME_RATE;
+        frame_cycles_left = 0;
+        loaded = true;
+        return 0;
+    }
+
+    int Chip8Emu::run_step(long cycles) {
+        long executed;
+        int status = run_hooked(cycles, executed);
+        if (status < 0) {
+            return -1;
+        }
+        cycles_executed += executed;
+        frame_cycles_left -= executed;
+        if (status == EXEC_HALTED) {
+            program_halted = true;
+            return 1;
+        }
+        if (frame_cycles_left == 0) {
+            cpu->decrement_timers();
+            display->present();
+        }
+        return status == EXEC_QUIT ? 1 : 0;
+    }
+
+    bool Chip8Emu::begin_step_frame() {
+        // Same carry as run_frame, so the frames come out the same length as in a full run
+        cycle_carry += step_cycles_per_frame;
+        frame_cycles_left = static_cast<long>(cycle_carry);
+        cycle_carry -= frame_cycles_left;
+        frame_idle = false;
+        if (frame_cycles_left == 0) {
+            cpu->decrement_timers();
+            display->present();
+            return false;
+        }
+        return true;
+    }
+
+    int Chip8Emu::step_cycles(unsigned long cycles) {
+        if (!loaded) {
+            std::cerr << "No program loaded to step\n";
+            return -1;
+        }
+        while (cycles > 0) {
+            if (frame_cycles_left == 0 && !begin_step_frame()) {
+                continue;
+            }
+            long cycles_now = std::min<unsigned long>(cycles, frame_cycles_left);
+            int status = run_step(cycles_now);
+            if (status != 0) {
+                return status;
+            }
+            cycles -= cycles_now;
+        }
+        return 0;
+    }
+
+    int Chip8Emu::step_frames(unsigned long frames) {
+        if (!loaded) {
+            std::cerr << "No program loaded to step\n";
+            return -1;
+        }
+        for (unsigned long frame = 0; frame < frames; frame++) {
+            if (frame_cycles_left == 0 && !begin_step_frame()) {
+                continue;
+            }
+            int status = run_step(frame_cycles_left);
+            if (status != 0) {
+                return status;
+            }
+        }
+        return 0;
+    }
+
+    void Chip8Emu::handle_command(HostCommand command) {
+        switch (command) {
+            case HOST_SAVE_STATE:
+                if (save_state_file(state_path) == 0) {
+                    std::cerr << "Saved state to " << state_path << '\n';
+                }
+                break;
+            case HOST_LOAD_STATE:
+                if (load_state_file(state_path) == 0) {
+                    std::cerr << "Loaded state from " << state_path << '\n';
+                }
+                break;
+            case HOST_WRITE_PROFILE:
+                if (profiler && profiler->dump(profile_path) == 0) {
+                    std::cerr << "Wrote profile to " << profile_path << '\n';
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    int Chip8Emu::run_loaded(const EmuOptions &options) {
+        double cycles_per_frame = options.cycles_per_frame ?
+            options.cycles_per_frame : static_cast<double>(options.cpu_freq) / FRAME_RATE;
+        Frontend *frontend = options.frontend;
+        engine = options.engine;
+        cpu->set_quirks(options.quirks);
+        display->set_palette(options.palette);
+        stop_on_halt = options.stop_on_halt;
+        program_halted = false;
+        // The limit counts from where this run starts, which matters when resuming a saved state
+        unsigned long cycle_limit = options.cycle_limit ? cycles_executed + options.cycle_limit : 0;
+        replaying_input = !options.replay_file.empty();
+        recording_input = !options.record_file.empty();
+        if (replaying_input) {
+            if (movie.load(options.replay_file) != 0) {
+                return -1;
+            }
+            if (movie.program_hash != program_hash) {
+                std::cerr << "The recording was made with a different program\n";
+                return -1;
+            }
+            if (movie.quirks != options.quirks) {
+                std::cerr << "The recording was made with a different quirk profile\n";
+                return -1;
+            }
+            cpu->seed_random(movie.seed);
+            cycles_per_frame = movie.cycles_per_frame;
+            cycle_limit = movie.end_cycle;
+        } else if (recording_input) {
+            movie = InputMovie();
+            movie.seed = options.seed;
+            movie.program_hash = program_hash;
+            movie.cycles_per_frame = cycles_per_frame;
+            movie.quirks = options.quirks;
+        }
+        detach_hooks();
+        if (!options.profile_file.empty()) {
+            profiler = new Profiler();
+            cpu->profiler = profiler;
+            profile_path = options.profile_file;
+        }
+        if (options.debug || !options.debug_socket.empty()) {
+            debugger = new Debugger();
+            if (debugger->open(options.debug_socket) != 0) {
+                return -1;
+            }
+            cpu->debugger = debugger;
+        }
+        // Skipped iterations would run past breakpoints and uncounted by the profiler
+        skip_idle = options.skip_idle && !profiler && !debugger;
+        if (!options.trace_file.empty()) {
+            tracer = new Tracer(options.trace_records);
+            cpu->tracer = tracer;
+            trace_path = options.trace_file;
+        }
+        // Only runs with a frontend are paced; headless runs go as fast as they can
+        const bool paced = frontend != nullptr;
+        delete video;
+        video = nullptr;
+        if (!options.video_file.empty()) {
+            video = new VideoRecorder();
+            // Unpaced runs have no deadline to keep, so they wait for the writer instead of losing frames
+            if (video->open(options.video_file, paced) != 0) {
                 return -1;
             }
-            while (SDL_PollEvent(&event)) {
-                if (event.type == SDL_QUIT) {
-                    running = false;
+        }
+        if (frontend) {
+            frontend->start();
+        }
+        FramePacer pacer(FRAME_RATE);
+        MachineState frame_state;
+        // Rewinding is only offered where the frames can be watched going back
+        if (options.rewind_seconds > 0 && frontend && frontend->display_backend()) {
+            delete rewind_buffer;
+            rewind_buffer = new RewindBuffer(options.rewind_seconds * FRAME_RATE, REWIND_CAPACITY,
+                    REWIND_KEYFRAME_INTERVAL);
+        }
+        bool running = !(replaying_input && cycles_executed >= cycle_limit);
+        int result = 0;
+        while (running) {
+            auto frame_start = Clock::now();
+            if (frontend) {
+                HostCommand command;
+                while ((command = frontend->next_command()) != HOST_NONE) {
+                    if (command == HOST_QUIT) {
+                        running = false;
+                    } else {
+                        handle_command(command);
+                    }
+                }
+            }
+            if (rewind_buffer && frontend->rewinding()) {
+                // Step one frame back per frame while the key is held
+                if (rewind_buffer->pop(frame_state)) {
+                    load_state(frame_state);
+                    display->present();
                 }
+                if (video) {
+                    video->capture(display->framebuffer(), display->hires());
+                }
+                pacer.wait_next_frame();
+                continue;
             }
-            keypad->handle_input(&event, kbstate, &cpu->PC);
-            cpu->decrement_timers();
-            frame_time = SDL_GetTicks() - frame_start;
-            if (FRAMEDELAY > frame_time) {
-                SDL_Delay(FRAMEDELAY - frame_time);
+            // Keys are sampled once per frame so a recording can reproduce them exactly
+            u_int16_t keys = 0;
+            if (replaying_input) {
+                keys = movie.keys_at(cycles_executed);
+            } else if (frontend) {
+                keys = frontend->frame_keys();
+            }
+            if (recording_input) {
+                movie.record(cycles_executed, keys);
+            }
+            if (profiler) {
+                profiler->add_time(PROFILE_INPUT, Clock::now() - frame_start);
+            }
+            int status = run_frame(cycles_per_frame, cycle_limit, keys);
+            if (status < 0) {
+                result = -1;
+                break;
+            } else if (status > 0) {
+                running = false;
+            }
+            if (video) {
+                video->capture(display->framebuffer(), display->hires());
+            }
+            if (frontend) {
+                frontend->play({cpu->timers[S] != 0, cpu->pitch, cpu->audio_pattern});
+            }
+            if (rewind_buffer) {
+                save_state(frame_state);
+                rewind_buffer->push(frame_state);
+            }
+            if (profiler) {
+                auto frame_end = Clock::now();
+                profiler->record_frame(frame_end - frame_start);
+                if (paced) {
+                    pacer.wait_next_frame(frame_idle);
+                    profiler->add_time(PROFILE_PACING, Clock::now() - frame_end);
+                }
+            } else if (paced) {
+                pacer.wait_next_frame(frame_idle);
             }
         }
-        return 0;
+        if (paced) {
+            pacer.report_jitter();
+        }
+        if (frontend) {
+            frontend->stop();
+        }
+        if (video) {
+            if (video->close() != 0) {
+                result = -1;
+            }
+            std::cerr << "Video: " << video->frames_captured() << " frames, " << video->frames_dropped()
+                << " dropped\n";
+        }
+        if (tracer && tracer->dump(trace_path) != 0) {
+            result = -1;
+        }
+        if (profiler && profiler->dump(profile_path) != 0) {
+            result = -1;
+        }
+        if (recording_input) {
+            movie.end_cycle = cycles_executed;
+            if (movie.save(options.record_file) != 0) {
+                result = -1;
+            }
+        }
+        return result;
     }
 
 }
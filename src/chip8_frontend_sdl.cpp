@@ -0,0 +1,77 @@
+#include "chip8_sdl.hpp"
+#include <iostream>
+
+namespace chip8 {
+
+    SdlFrontend::~SdlFrontend() {
+        keyboard.detach();
+        delete audio;
+        delete display;
+    }
+
+    int SdlFrontend::open(std::string title, bool window, short scaling_factor, double persistence, int audio_buffer) {
+        if (window) {
+            display = new SdlDisplayBackend();
+            if (display->init(title, scaling_factor, persistence) != 0) {
+                std::cerr << "Error while initializing display\n";
+                return -1;
+            }
+        }
+        if (audio_buffer > 0) {
+            audio = new AudioOutput();
+            if (audio->open(audio_buffer) != 0) {
+                std::cerr << "Continuing without sound\n";
+                delete audio;
+                audio = nullptr;
+            }
+        }
+        return 0;
+    }
+
+    void SdlFrontend::start() {
+        if (display) {
+            keyboard.attach();
+        }
+    }
+
+    void SdlFrontend::stop() {
+        keyboard.detach();
+        if (audio) {
+            audio->close();
+            audio->report_buffers();
+        }
+    }
+
+    HostCommand SdlFrontend::next_command() {
+        if (!display) {
+            return HOST_NONE;
+        }
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                return HOST_QUIT;
+            }
+            if (event.type != SDL_KEYDOWN || event.key.repeat) {
+                continue;
+            }
+            switch (event.key.keysym.scancode) {
+                case SDL_SCANCODE_F5: return HOST_SAVE_STATE;
+                case SDL_SCANCODE_F9: return HOST_LOAD_STATE;
+                case SDL_SCANCODE_F7: return HOST_WRITE_PROFILE;
+                default: break;
+            }
+        }
+        return HOST_NONE;
+    }
+
+    bool SdlFrontend::rewinding() {
+        return display && SDL_GetKeyboardState(NULL)[SDL_SCANCODE_BACKSPACE];
+    }
+
+    void SdlFrontend::play(const SoundFrame &frame) {
+        if (audio) {
+            audio->publish(frame);
+        }
+    }
+
+}
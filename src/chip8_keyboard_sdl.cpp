@@ -0,0 +1,62 @@
+#include "chip8_sdl.hpp"
+
+#define NO_KEY 0xFF
+
+namespace chip8 {
+
+    // Laid out on the left of a QWERTY keyboard
+    const KeyMap DEFAULT_KEY_MAP = {
+        SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+        SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+        SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+        SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V,
+    };
+
+    void KeyboardInput::set_key_map(const KeyMap &key_map) {
+        scancode_keys.fill(NO_KEY);
+        for (u_int8_t key = 0; key < 16; key++) {
+            scancode_keys[key_map[key]] = key;
+        }
+    }
+
+    void KeyboardInput::attach() {
+        if (!attached) {
+            SDL_AddEventWatch(on_event, this);
+            attached = true;
+        }
+    }
+
+    void KeyboardInput::detach() {
+        if (attached) {
+            SDL_DelEventWatch(on_event, this);
+            attached = false;
+        }
+    }
+
+    int KeyboardInput::on_event(void *userdata, SDL_Event *event) {
+        if ((event->type == SDL_KEYDOWN && !event->key.repeat) || event->type == SDL_KEYUP) {
+            KeyboardInput *input = static_cast<KeyboardInput *>(userdata);
+            u_int8_t key = input->scancode_keys[event->key.keysym.scancode];
+            if (key != NO_KEY) {
+                // A full queue means the frame loop is far behind; dropping the event is the lesser evil
+                input->events.push({key, event->type == SDL_KEYDOWN});
+            }
+        }
+        return 0;
+    }
+
+    u_int16_t KeyboardInput::frame_keys() {
+        u_int16_t pressed = 0;
+        KeyEvent event;
+        while (events.pop(event)) {
+            if (event.down) {
+                held |= 1 << event.key;
+                pressed |= 1 << event.key;
+            } else {
+                held &= ~(1 << event.key);
+            }
+        }
+        return held | pressed;
+    }
+
+}
@@ -0,0 +1,137 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+// File layout, little-endian: "C8MV", u16 version, u32 seed, u64 program hash, f64 cycles per frame,
+// u8 quirk profile, u64 end cycle, u32 event count, then per event a varint cycle delta and a u16 key mask
+#define MOVIE_MAGIC "C8MV"
+
+static void put_le(std::ostream &out, u_int64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.put(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+static bool get_le(std::istream &in, u_int64_t &value, int bytes) {
+    value = 0;
+    for (int i = 0; i < bytes; i++) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= static_cast<u_int64_t>(byte) << (8 * i);
+    }
+    return true;
+}
+
+static void put_varint(std::ostream &out, u_int64_t value) {
+    while (value >= 0x80) {
+        out.put(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.put(static_cast<char>(value));
+}
+
+static bool get_varint(std::istream &in, u_int64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= static_cast<u_int64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+namespace chip8 {
+
+    void InputMovie::record(u_int64_t cycle, u_int16_t keys) {
+        u_int16_t last = events.empty() ? 0 : events.back().keys;
+        if (keys != last) {
+            events.push_back({cycle, keys});
+        }
+    }
+
+    void InputMovie::truncate(u_int64_t cycle) {
+        while (!events.empty() && events.back().cycle > cycle) {
+            events.pop_back();
+        }
+    }
+
+    u_int16_t InputMovie::keys_at(u_int64_t cycle) {
+        while (next_event < events.size() && events[next_event].cycle <= cycle) {
+            current_keys = events[next_event++].keys;
+        }
+        return current_keys;
+    }
+
+    int InputMovie::save(std::string path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out.good()) {
+            std::cerr << "Could not open " << path << " for writing\n";
+            return -1;
+        }
+        u_int64_t cycles_per_frame_bits;
+        std::memcpy(&cycles_per_frame_bits, &cycles_per_frame, sizeof cycles_per_frame_bits);
+        out.write(MOVIE_MAGIC, 4);
+        put_le(out, MOVIE_VERSION, 2);
+        put_le(out, seed, 4);
+        put_le(out, program_hash, 8);
+        put_le(out, cycles_per_frame_bits, 8);
+        put_le(out, quirks, 1);
+        put_le(out, end_cycle, 8);
+        put_le(out, events.size(), 4);
+        u_int64_t last_cycle = 0;
+        for (const Event &event : events) {
+            put_varint(out, event.cycle - last_cycle);
+            put_le(out, event.keys, 2);
+            last_cycle = event.cycle;
+        }
+        if (!out.good()) {
+            std::cerr << "Could not write recording to " << path << '\n';
+            return -1;
+        }
+        return 0;
+    }
+
+    int InputMovie::load(std::string path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.good()) {
+            std::cerr << "Could not open " << path << '\n';
+            return -1;
+        }
+        char magic[4];
+        u_int64_t version, seed_value, cycles_per_frame_bits, quirks_value, count;
+        if (!in.read(magic, 4) || std::memcmp(magic, MOVIE_MAGIC, 4) != 0
+                || !get_le(in, version, 2) || version != MOVIE_VERSION) {
+            std::cerr << path << " is not a compatible input recording\n";
+            return -1;
+        }
+        if (!get_le(in, seed_value, 4) || !get_le(in, program_hash, 8) || !get_le(in, cycles_per_frame_bits, 8)
+                || !get_le(in, quirks_value, 1) || !get_le(in, end_cycle, 8) || !get_le(in, count, 4)) {
+            std::cerr << path << " is truncated\n";
+            return -1;
+        }
+        if (quirks_value > QUIRKS_XOCHIP) {
+            std::cerr << path << " has an unknown quirk profile\n";
+            return -1;
+        }
+        seed = seed_value;
+        quirks = static_cast<QuirkProfile>(quirks_value);
+        std::memcpy(&cycles_per_frame, &cycles_per_frame_bits, sizeof cycles_per_frame);
+        events.clear();
+        u_int64_t cycle = 0;
+        for (u_int64_t i = 0; i < count; i++) {
+            u_int64_t delta, keys;
+            if (!get_varint(in, delta) || !get_le(in, keys, 2)) {
+                std::cerr << path << " is truncated\n";
+                return -1;
+            }
+            cycle += delta;
+            events.push_back({cycle, static_cast<u_int16_t>(keys)});
+        }
+        next_event = 0;
+        current_keys = 0;
+        return 0;
+    }
+
+}
@@ -0,0 +1,71 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+static const char *SECTION_NAMES[chip8::PROFILE_SECTIONS] = {"draw", "input", "pacing"};
+
+namespace chip8 {
+
+    void Profiler::record_frame(Clock::duration spent) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(spent).count();
+        // Bucket k holds frames of [2^k, 2^(k+1)) microseconds; bucket 0 also takes anything shorter
+        int bucket = 0;
+        while (us > 1 && bucket < PROFILE_FRAME_BUCKETS - 1) {
+            us >>= 1;
+            ++bucket;
+        }
+        ++frame_buckets[bucket];
+        ++frames;
+    }
+
+    void Profiler::write_json(std::ostream &out) const {
+        u_int64_t instructions = 0;
+        for (u_int64_t count : class_counts) {
+            instructions += count;
+        }
+        out << "{\n    \"instructions\": " << instructions << ",\n    \"frames\": " << frames << ",\n";
+        out << "    \"opcode_classes\": {";
+        for (int op_class = 0; op_class < 16; op_class++) {
+            out << (op_class ? ", " : "") << "\"" << std::hex << std::uppercase << op_class << "\": "
+                << std::dec << class_counts[op_class];
+        }
+        out << "},\n    \"hot_pcs\": [";
+        std::vector<u_int16_t> pcs;
+        for (int addr = 0; addr < MEMCELL_MAX; addr++) {
+            if (pc_counts[addr]) pcs.push_back(addr);
+        }
+        size_t shown = std::min<size_t>(pcs.size(), PROFILE_HOT_PCS);
+        std::partial_sort(pcs.begin(), pcs.begin() + shown, pcs.end(), [this](u_int16_t a, u_int16_t b) {
+            return pc_counts[a] > pc_counts[b];
+        });
+        for (size_t i = 0; i < shown; i++) {
+            out << (i ? "," : "") << "\n        {\"pc\": " << pcs[i] << ", \"count\": " << pc_counts[pcs[i]] << "}";
+        }
+        out << "\n    ],\n    \"section_ms\": {";
+        for (int section = 0; section < PROFILE_SECTIONS; section++) {
+            out << (section ? ", " : "") << "\"" << SECTION_NAMES[section] << "\": "
+                << std::chrono::duration<double, std::milli>(section_time[section]).count();
+        }
+        out << "},\n    \"frame_us_histogram\": [";
+        bool first = true;
+        for (int bucket = 0; bucket < PROFILE_FRAME_BUCKETS; bucket++) {
+            if (!frame_buckets[bucket]) continue;
+            out << (first ? "" : ",") << "\n        {\"from_us\": " << (bucket ? 1ul << bucket : 0)
+                << ", \"frames\": " << frame_buckets[bucket] << "}";
+            first = false;
+        }
+        out << "\n    ]\n}\n";
+    }
+
+    int Profiler::dump(std::string path) const {
+        std::ofstream out(path);
+        write_json(out);
+        if (!out) {
+            std::cerr << "Could not write profile to " << path << '\n';
+            return -1;
+        }
+        return 0;
+    }
+
+}
@@ -0,0 +1,157 @@
+#include "chip8.hpp"
+#include <cstring>
+#include <algorithm>
+
+#define STATE_SIZE sizeof(chip8::MachineState)
+
+inline void put_varint(std::vector<u_int8_t> &out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(value);
+}
+
+// False when the varint runs past end or does not fit a size_t
+inline bool get_varint(const u_int8_t *&in, const u_int8_t *end, size_t &value) {
+    value = 0;
+    for (int shift = 0; in != end && shift < 64; shift += 7) {
+        u_int8_t byte = *in++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+namespace chip8 {
+
+    void encode_delta(const u_int8_t *current, const u_int8_t *base, size_t size, std::vector<u_int8_t> &out) {
+        out.clear();
+        size_t i = 0;
+        while (i < size) {
+            size_t zeros = 0;
+            while (i + zeros < size && current[i + zeros] == base[i + zeros]) ++zeros;
+            size_t literal_start = i + zeros;
+            size_t literals = 0;
+            // A literal run ends at the first stretch of 4 unchanged bytes, which is cheaper to encode as a zero run
+            while (literal_start + literals < size) {
+                size_t at = literal_start + literals;
+                size_t same = 0;
+                while (same < 4 && at + same < size && current[at + same] == base[at + same]) ++same;
+                if (same == 4 || at + same == size) break;
+                literals += same + 1;
+            }
+            literals = std::min(literals, size - literal_start);
+            put_varint(out, zeros);
+            put_varint(out, literals);
+            for (size_t k = 0; k < literals; k++) {
+                out.push_back(current[literal_start + k] ^ base[literal_start + k]);
+            }
+            i = literal_start + literals;
+        }
+    }
+
+    bool apply_delta(const u_int8_t *in, size_t in_size, u_int8_t *data, size_t size) {
+        const u_int8_t *end = in + in_size;
+        size_t i = 0;
+        while (i < size) {
+            size_t zeros, literals;
+            if (!get_varint(in, end, zeros) || !get_varint(in, end, literals) || zeros > size - i
+                    || literals > size - i - zeros || literals > static_cast<size_t>(end - in)) {
+                return false;
+            }
+            i += zeros;
+            for (size_t k = 0; k < literals; k++) {
+                data[i++] ^= *in++;
+            }
+        }
+        return in == end;
+    }
+
+    RewindBuffer::RewindBuffer(size_t max_frames, size_t capacity_bytes, unsigned keyframe_interval)
+        : max_frames(max_frames), keyframe_interval(keyframe_interval ? keyframe_interval : 1), ring(capacity_bytes) {
+        // Worst case encoding: every byte a literal plus a few bytes of run lengths
+        scratch.reserve(STATE_SIZE + 16);
+    }
+
+    void RewindBuffer::push(const MachineState &state) {
+        static const MachineState ZERO_STATE = {};
+        const u_int8_t *current = reinterpret_cast<const u_int8_t *>(&state);
+        bool is_keyframe = entries.empty() || frames_since_keyframe + 1 >= keyframe_interval;
+        encode_delta(current, reinterpret_cast<const u_int8_t *>(is_keyframe ? &ZERO_STATE : &keyframe), STATE_SIZE,
+                scratch);
+        while (!entries.empty() && (entries.size() >= max_frames || ring.size() - used < scratch.size())) {
+            evict_oldest();
+        }
+        if (entries.empty() && !is_keyframe) {
+            // The keyframe this delta was made against has just been evicted
+            is_keyframe = true;
+            encode_delta(current, reinterpret_cast<const u_int8_t *>(&ZERO_STATE), STATE_SIZE, scratch);
+        }
+        if (scratch.size() > ring.size()) return;
+        if (is_keyframe) {
+            keyframe = state;
+            frames_since_keyframe = 0;
+        } else {
+            ++frames_since_keyframe;
+        }
+        store(scratch, scratch.size(), is_keyframe);
+    }
+
+    void RewindBuffer::store(const std::vector<u_int8_t> &encoded, size_t size, bool is_keyframe) {
+        size_t first = std::min(size, ring.size() - head);
+        std::memcpy(&ring[head], encoded.data(), first);
+        std::memcpy(&ring[0], encoded.data() + first, size - first);
+        entries.push_back({head, size, is_keyframe});
+        head = (head + size) % ring.size();
+        used += size;
+    }
+
+    void RewindBuffer::read(const Entry &entry, std::vector<u_int8_t> &out) const {
+        out.resize(entry.size);
+        size_t first = std::min(entry.size, ring.size() - entry.offset);
+        std::memcpy(out.data(), &ring[entry.offset], first);
+        std::memcpy(out.data() + first, &ring[0], entry.size - first);
+    }
+
+    void RewindBuffer::evict_oldest() {
+        // Deltas are useless without their keyframe, so the whole group goes
+        do {
+            used -= entries.front().size;
+            entries.pop_front();
+        } while (!entries.empty() && !entries.front().keyframe);
+    }
+
+    void RewindBuffer::decode_keyframe_for_newest() {
+        size_t index = entries.size() - 1;
+        frames_since_keyframe = 0;
+        while (!entries[index].keyframe) {
+            --index;
+            ++frames_since_keyframe;
+        }
+        read(entries[index], scratch);
+        std::memset(&keyframe, 0, STATE_SIZE);
+        apply_delta(scratch.data(), scratch.size(), reinterpret_cast<u_int8_t *>(&keyframe), STATE_SIZE);
+    }
+
+    bool RewindBuffer::pop(MachineState &state) {
+        if (entries.empty()) return false;
+        // keyframe always belongs to the group of the newest entry
+        const Entry newest = entries.back();
+        state = keyframe;
+        if (!newest.keyframe) {
+            read(newest, scratch);
+            apply_delta(scratch.data(), scratch.size(), reinterpret_cast<u_int8_t *>(&state), STATE_SIZE);
+        }
+        used -= newest.size;
+        head = newest.offset;
+        entries.pop_back();
+        if (newest.keyframe) {
+            if (!entries.empty()) decode_keyframe_for_newest();
+        } else {
+            --frames_since_keyframe;
+        }
+        return true;
+    }
+
+}
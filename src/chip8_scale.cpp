@@ -0,0 +1,228 @@
+#include "chip8.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCALE_X86
+#endif
+
+// The widest store writes this many pixels, so a pixel's last store may run this far into the next one's
+#define SCALE_PAD 8
+
+#define NATIVE_PIXELS (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+// Blends shown towards target, keeping keep/256 of the difference. The kept part is truncated towards zero so
+// every channel reaches its target, whichever side it approaches from. Returns whether any pixel is still fading.
+static bool blend_scalar(const uint32_t *target, uint32_t *shown, int keep) {
+    bool fading = false;
+    for (int i = 0; i < NATIVE_PIXELS; i++) {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            int to = (target[i] >> shift) & 0xFF;
+            int difference = static_cast<int>((shown[i] >> shift) & 0xFF) - to;
+            int kept = difference < 0 ? -((-difference * keep) >> 8) : (difference * keep) >> 8;
+            result |= static_cast<uint32_t>(to + kept) << shift;
+        }
+        fading |= result != target[i];
+        shown[i] = result;
+    }
+    return fading;
+}
+
+// Every pixel is repeated scale times across, and every row scale times down
+static void expand_scalar(const uint32_t *shown, uint32_t *out, int scale) {
+    const int width = SCREEN_WIDTH * scale;
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t *line = out + static_cast<size_t>(y) * scale * width;
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            std::fill_n(line + x * scale, scale, shown[y * SCREEN_WIDTH + x]);
+        }
+        for (int copy = 1; copy < scale; copy++) {
+            std::memcpy(line + copy * width, line, width * sizeof(uint32_t));
+        }
+    }
+}
+
+#ifdef SCALE_X86
+
+// Channels widened to 16 bits; weight is keep << 1, so the high half of the product is difference * keep >> 8
+static inline __m128i fade_sse2(__m128i to, __m128i from, __m128i weight) {
+    __m128i difference = _mm_sub_epi16(from, to);
+    __m128i negative = _mm_srai_epi16(difference, 15);
+    __m128i magnitude = _mm_sub_epi16(_mm_xor_si128(difference, negative), negative);
+    __m128i kept = _mm_mulhi_epi16(_mm_slli_epi16(magnitude, 7), weight);
+    return _mm_add_epi16(to, _mm_sub_epi16(_mm_xor_si128(kept, negative), negative));
+}
+
+static bool blend_sse2(const uint32_t *target, uint32_t *shown, int keep) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weight = _mm_set1_epi16(keep << 1);
+    __m128i differs = zero;
+    for (int i = 0; i < NATIVE_PIXELS; i += 4) {
+        __m128i to = _mm_loadu_si128(reinterpret_cast<const __m128i *>(target + i));
+        __m128i from = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shown + i));
+        __m128i low = fade_sse2(_mm_unpacklo_epi8(to, zero), _mm_unpacklo_epi8(from, zero), weight);
+        __m128i high = fade_sse2(_mm_unpackhi_epi8(to, zero), _mm_unpackhi_epi8(from, zero), weight);
+        __m128i result = _mm_packus_epi16(low, high);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(shown + i), result);
+        differs = _mm_or_si128(differs, _mm_xor_si128(result, to));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(differs, zero)) != 0xFFFF;
+}
+
+static void expand_sse2(const uint32_t *shown, uint32_t *out, int scale) {
+    const int width = SCREEN_WIDTH * scale;
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t *line = out + static_cast<size_t>(y) * scale * width;
+        uint32_t *pixel = line;
+        // Stores overrunning a pixel are overwritten by the next one; past the end of the row, by the row's copies
+        for (int x = 0; x < SCREEN_WIDTH; x++, pixel += scale) {
+            __m128i colour = _mm_set1_epi32(shown[y * SCREEN_WIDTH + x]);
+            for (int i = 0; i < scale; i += 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(pixel + i), colour);
+            }
+        }
+        for (int copy = 1; copy < scale; copy++) {
+            std::memcpy(line + copy * width, line, width * sizeof(uint32_t));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fade_avx2(__m256i to, __m256i from, __m256i weight) {
+    __m256i difference = _mm256_sub_epi16(from, to);
+    __m256i negative = _mm256_srai_epi16(difference, 15);
+    __m256i magnitude = _mm256_sub_epi16(_mm256_xor_si256(difference, negative), negative);
+    __m256i kept = _mm256_mulhi_epi16(_mm256_slli_epi16(magnitude, 7), weight);
+    return _mm256_add_epi16(to, _mm256_sub_epi16(_mm256_xor_si256(kept, negative), negative));
+}
+
+__attribute__((target("avx2")))
+static bool blend_avx2(const uint32_t *target, uint32_t *shown, int keep) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weight = _mm256_set1_epi16(keep << 1);
+    __m256i differs = zero;
+    for (int i = 0; i < NATIVE_PIXELS; i += 8) {
+        __m256i to = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(target + i));
+        __m256i from = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(shown + i));
+        // Unpacking and packing both work within 128 bit lanes, so the pixels come back in order
+        __m256i low = fade_avx2(_mm256_unpacklo_epi8(to, zero), _mm256_unpacklo_epi8(from, zero), weight);
+        __m256i high = fade_avx2(_mm256_unpackhi_epi8(to, zero), _mm256_unpackhi_epi8(from, zero), weight);
+        __m256i result = _mm256_packus_epi16(low, high);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(shown + i), result);
+        differs = _mm256_or_si256(differs, _mm256_xor_si256(result, to));
+    }
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(differs, zero)) != -1;
+}
+
+__attribute__((target("avx2")))
+static void expand_avx2(const uint32_t *shown, uint32_t *out, int scale) {
+    const int width = SCREEN_WIDTH * scale;
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t *line = out + static_cast<size_t>(y) * scale * width;
+        uint32_t *pixel = line;
+        for (int x = 0; x < SCREEN_WIDTH; x++, pixel += scale) {
+            __m256i colour = _mm256_set1_epi32(shown[y * SCREEN_WIDTH + x]);
+            for (int i = 0; i < scale; i += 8) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(pixel + i), colour);
+            }
+        }
+        for (int copy = 1; copy < scale; copy++) {
+            std::memcpy(line + copy * width, line, width * sizeof(uint32_t));
+        }
+    }
+}
+
+#endif
+
+namespace chip8 {
+
+    ScaleKernel FrameScaler::best_kernel() {
+#ifdef SCALE_X86
+        // SSE2 is part of x86-64
+        return __builtin_cpu_supports("avx2") ? SCALE_AVX2 : SCALE_SSE2;
+#else
+        return SCALE_SCALAR;
+#endif
+    }
+
+    void FrameScaler::configure(int scale, double persistence, ScaleKernel kernel) {
+        this->scale = std::max(scale, 1);
+        keep = std::clamp(static_cast<int>(std::lround(persistence * 256)), 0, 255);
+#ifdef SCALE_X86
+        this->kernel = kernel == SCALE_AVX2 && !__builtin_cpu_supports("avx2") ? SCALE_SSE2 : kernel;
+#else
+        this->kernel = SCALE_SCALAR;
+        (void)kernel;
+#endif
+        target.assign(NATIVE_PIXELS, 0);
+        shown.assign(NATIVE_PIXELS, 0);
+        output.assign(static_cast<size_t>(width()) * height() + SCALE_PAD, 0);
+        primed = false;
+        still_fading = false;
+    }
+
+    void FrameScaler::set_palette(const Palette &palette) {
+        for (int nibbles = 0; nibbles < 256; nibbles++) {
+            for (int i = 0; i < 4; i++) {
+                int bit = 3 - i;
+                nibble_colours[nibbles][i] = palette[((nibbles >> bit) & 1) | (((nibbles >> (bit + 4)) & 1) << 1)];
+            }
+        }
+    }
+
+    void FrameScaler::decode(const Framebuffer &framebuffer, bool hires) {
+        for (int y = 0; y < SCREEN_HEIGHT; y++) {
+            uint32_t *line = &target[y * SCREEN_WIDTH];
+            if (!hires && (y & 1)) {
+                // Low resolution rows are two high
+                std::memcpy(line, line - SCREEN_WIDTH, SCREEN_WIDTH * sizeof(uint32_t));
+                continue;
+            }
+            int row = hires ? y : y / 2;
+            // Four pixels at a time, from the top nibble of each 64 bit half; low resolution rows are the top half
+            for (int half = 0; half < (hires ? 2 : 1); half++) {
+                uint64_t plane0 = static_cast<uint64_t>(framebuffer[0][row] >> (64 * (1 - half)));
+                uint64_t plane1 = static_cast<uint64_t>(framebuffer[1][row] >> (64 * (1 - half)));
+                for (int x = 0; x < 64; x += 4, plane0 <<= 4, plane1 <<= 4) {
+                    const std::array<uint32_t, 4> &colours = nibble_colours[(plane0 >> 60) | ((plane1 >> 60) << 4)];
+                    if (hires) {
+                        std::memcpy(line + half * 64 + x, colours.data(), sizeof colours);
+                    } else {
+                        for (int i = 0; i < 4; i++) {
+                            line[2 * (x + i)] = line[2 * (x + i) + 1] = colours[i];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const uint32_t *FrameScaler::render(const Framebuffer &framebuffer, bool hires) {
+        decode(framebuffer, hires);
+        if (keep == 0 || !primed) {
+            shown.swap(target);
+            still_fading = false;
+            primed = true;
+        } else {
+            switch (kernel) {
+#ifdef SCALE_X86
+                case SCALE_AVX2: still_fading = blend_avx2(target.data(), shown.data(), keep); break;
+                case SCALE_SSE2: still_fading = blend_sse2(target.data(), shown.data(), keep); break;
+#endif
+                default: still_fading = blend_scalar(target.data(), shown.data(), keep); break;
+            }
+        }
+        switch (kernel) {
+#ifdef SCALE_X86
+            case SCALE_AVX2: expand_avx2(shown.data(), output.data(), scale); break;
+            case SCALE_SSE2: expand_sse2(shown.data(), output.data(), scale); break;
+#endif
+            default: expand_scalar(shown.data(), output.data(), scale); break;
+        }
+        return output.data();
+    }
+
+}
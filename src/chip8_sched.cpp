@@ -0,0 +1,50 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+
+// Sleeps are only trusted up to this close to a deadline; the rest is spun
+#define SPIN_MARGIN std::chrono::microseconds(1500)
+
+namespace chip8 {
+
+    FramePacer::FramePacer(double frames_per_second) {
+        frame_period = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1.0 / frames_per_second));
+    }
+
+    void FramePacer::wait_next_frame(bool idle) {
+        if (!started) {
+            started = true;
+            next_deadline = Clock::now() + frame_period;
+            return;
+        }
+        auto now = Clock::now();
+        if (idle) {
+            // The program is only waiting, and whatever it drew this frame was presented before pacing, so
+            // oversleeping a little just starts the next frame late; that beats keeping a core busy
+            std::this_thread::sleep_until(next_deadline);
+        } else if (next_deadline - now > SPIN_MARGIN) {
+            std::this_thread::sleep_for(next_deadline - now - SPIN_MARGIN);
+        }
+        while ((now = Clock::now()) < next_deadline) {
+            // Spin
+        }
+        double late_us = std::chrono::duration<double, std::micro>(now - next_deadline).count();
+        jitter_total_us += late_us;
+        jitter_max_us = std::max(jitter_max_us, late_us);
+        ++frames_paced;
+        // Deadlines are absolute so rounding never accumulates; after a long stall, resync instead of bursting
+        next_deadline += frame_period;
+        if (now - next_deadline > frame_period) {
+            next_deadline = now + frame_period;
+        }
+    }
+
+    void FramePacer::report_jitter() const {
+        if (frames_paced == 0) return;
+        std::cerr << "Frame pacing: " << frames_paced << " frames, jitter mean "
+            << (jitter_total_us / frames_paced) << "us, max " << jitter_max_us << "us\n";
+    }
+
+}
@@ -0,0 +1,129 @@
+#ifndef CHIP8_SDL_H
+#define CHIP8_SDL_H
+
+#include "chip8.hpp"
+#include <SDL2/SDL.h>
+
+// The SDL frontend: a window, keyboard input and sound. Nothing in the core depends on it.
+
+namespace chip8 {
+
+    class SdlDisplayBackend : public DisplayBackend {
+        public:
+            ~SdlDisplayBackend();
+            // scaling_factor is the window size of a low resolution pixel; persistence is the phosphor decay
+            int init(std::string title, const short scaling_factor, double persistence);
+            void render(const Framebuffer &framebuffer, bool hires) override;
+            void set_palette(const Palette &palette) override { scaler.set_palette(palette); }
+            bool animating() const override { return scaler.fading(); }
+        private:
+            FrameScaler scaler;
+            SDL_Window *window = NULL;
+            SDL_Renderer *renderer = NULL;
+            // Streaming texture at window resolution, so the GPU copies it without filtering; for odd scaling
+            // factors, at the even one below, which the GPU stretches to fit, and at factor 1, at 2, which it shrinks
+            SDL_Texture *texture = NULL;
+    };
+
+    // Scancode for each CHIP-8 key
+    using KeyMap = std::array<SDL_Scancode, 16>;
+    extern const KeyMap DEFAULT_KEY_MAP;
+
+    struct KeyEvent {
+        u_int8_t key;
+        bool down;
+    };
+
+    // Collects keypad presses from SDL as they are pumped and hands them to the frame loop through a queue
+    class KeyboardInput {
+        public:
+            KeyboardInput() { set_key_map(DEFAULT_KEY_MAP); }
+            ~KeyboardInput() { detach(); }
+            // Must not be called while attached
+            void set_key_map(const KeyMap &key_map);
+            void attach();
+            void detach();
+            // The key mask for the next frame. A key pressed and released since the last frame still reads
+            // as down for this one, so short taps are not lost between frames.
+            u_int16_t frame_keys();
+        private:
+            static int on_event(void *userdata, SDL_Event *event);
+            SpscQueue<KeyEvent, 64> events;
+            // CHIP-8 key for each scancode, NO_KEY for scancodes that are not on the keypad
+            std::array<u_int8_t, SDL_NUM_SCANCODES> scancode_keys;
+            u_int16_t held = 0;
+            bool attached = false;
+    };
+
+    #define AUDIO_SAMPLE_RATE 48000
+    // Output level of the square wave, out of 32767
+    #define AUDIO_AMPLITUDE 3000
+    // Frequency of the beep for programs that never load an XO-CHIP pattern
+    #define AUDIO_BEEP_HZ 440
+
+    // Plays the sound timer through an SDL audio device. The frame loop publishes one SoundFrame per frame
+    // through a lock-free queue; the audio callback drains it and synthesizes from the newest, so the audio
+    // thread never takes a lock. While the queue is full the newest frame waits outside it, so a stalled
+    // callback loses the frames in between rather than the latest one. Works with any SDL audio driver,
+    // including dummy and disk.
+    class AudioOutput {
+        public:
+            ~AudioOutput() { close(); }
+            // buffer_samples is the device buffer size, which bounds the output latency
+            int open(int buffer_samples);
+            void close();
+            void publish(const SoundFrame &frame);
+            // Callbacks, and callbacks that started later than the previous buffer could have lasted
+            unsigned long callbacks() const { return callback_count.load(std::memory_order_relaxed); }
+            unsigned long underruns() const { return underrun_count.load(std::memory_order_relaxed); }
+            // Frames replaced by a newer one before the queue had room for them
+            unsigned long overruns() const { return overrun_count; }
+            void report_buffers() const;
+        private:
+            static void on_audio(void *userdata, Uint8 *stream, int len);
+            void fill(int16_t *samples, int count);
+            SDL_AudioDeviceID device = 0;
+            int sample_rate = AUDIO_SAMPLE_RATE;
+            int buffer_samples = 0;
+            SpscQueue<SoundFrame, 16> frames;
+            // Only touched by the frame loop
+            SoundFrame pending = {};
+            bool has_pending = false;
+            unsigned long overrun_count = 0;
+            // Only touched by the audio thread
+            SoundFrame current = {};
+            double phase = 0;
+            Clock::time_point last_callback;
+            std::atomic<unsigned long> callback_count{0};
+            std::atomic<unsigned long> underrun_count{0};
+    };
+
+    // Shows the display in a window, reads the keypad from the keyboard and F5/F9/F7 as hotkeys, rewinds while
+    // Backspace is held, and plays the sound timer. Either part can be left out: a run with sound and no window
+    // is still paced in real time. The audio device is closed when the run stops, so a frontend serves one run.
+    class SdlFrontend : public Frontend {
+        public:
+            ~SdlFrontend();
+            // Must not be called during a run
+            void set_key_map(const KeyMap &key_map) { keyboard.set_key_map(key_map); }
+            // audio_buffer is the device buffer in samples, or 0 for no sound. Failing to open the audio device
+            // only loses the sound; failing to open the window is an error.
+            int open(std::string title, bool window, short scaling_factor, double persistence, int audio_buffer);
+            bool has_window() const { return display != nullptr; }
+            bool has_audio() const { return audio != nullptr; }
+            DisplayBackend *display_backend() override { return display; }
+            void start() override;
+            void stop() override;
+            HostCommand next_command() override;
+            u_int16_t frame_keys() override { return display ? keyboard.frame_keys() : 0; }
+            bool rewinding() override;
+            void play(const SoundFrame &frame) override;
+        private:
+            SdlDisplayBackend *display = nullptr;
+            AudioOutput *audio = nullptr;
+            KeyboardInput keyboard;
+    };
+
+}
+
+#endif
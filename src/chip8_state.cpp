@@ -0,0 +1,156 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::is_trivially_copyable<chip8::MachineState>::value, "MachineState must be copyable as raw bytes");
+
+namespace chip8 {
+
+    void Chip8Cpu::save_state(MachineState &state) const {
+        state.regs = regs;
+        state.timers = timers;
+        state.PC = PC;
+        state.I = I;
+        state.SP = SP;
+        state.rng_state = rng_state;
+        state.flag_regs = flag_regs;
+        state.audio_pattern = audio_pattern;
+        state.pitch = pitch;
+    }
+
+    void Chip8Cpu::load_state(const MachineState &state) {
+        regs = state.regs;
+        timers = state.timers;
+        PC = state.PC;
+        I = state.I;
+        SP = state.SP;
+        rng_state = state.rng_state;
+        flag_regs = state.flag_regs;
+        audio_pattern = state.audio_pattern;
+        pitch = state.pitch;
+        invalidate_decode_cache();
+    }
+
+    void Chip8Keypad::save_state(MachineState &state) const {
+        state.waiting_for_key = waiting_for_key;
+        state.keys_held_at_wait = keys_held_at_wait;
+    }
+
+    void Chip8Keypad::load_state(const MachineState &state) {
+        waiting_for_key = state.waiting_for_key;
+        keys_held_at_wait = state.keys_held_at_wait;
+    }
+
+    void Chip8Display::save_state(MachineState &state) const {
+        state.framebuffer = planes;
+        state.hires = high_resolution;
+        state.plane_mask = plane_mask;
+    }
+
+    void Chip8Display::load_state(const MachineState &state) {
+        planes = state.framebuffer;
+        high_resolution = state.hires;
+        select_planes(state.plane_mask);
+        dirty = true;
+    }
+
+    void Chip8Emu::save_state(MachineState &state) const {
+        std::memset(&state, 0, sizeof state);
+        state.magic = STATE_MAGIC;
+        state.version = STATE_VERSION;
+        state.cycles_executed = cycles_executed;
+        state.cycle_carry = cycle_carry;
+        display->save_state(state);
+        state.ram = memory->ram;
+        state.stack = memory->stack;
+        cpu->save_state(state);
+        keypad->save_state(state);
+    }
+
+    int Chip8Emu::load_state(const MachineState &state) {
+        if (state.magic != STATE_MAGIC || state.version != STATE_VERSION) {
+            std::cerr << "Not a compatible save state\n";
+            return -1;
+        }
+        // Fields the machine indexes with are checked before anything is restored, so a bad file changes nothing
+        if (state.SP > STACK_MAX || state.plane_mask >= (1 << PLANES) || state.hires > 1
+                || state.waiting_for_key > 1) {
+            std::cerr << "Save state is corrupt\n";
+            return -1;
+        }
+        cycles_executed = state.cycles_executed;
+        cycle_carry = state.cycle_carry;
+        display->load_state(state);
+        memory->ram = state.ram;
+        memory->stack = state.stack;
+        cpu->load_state(state);
+        keypad->load_state(state);
+        program_halted = false;
+        if (recording_input) {
+            // Whatever was recorded past this point no longer happened
+            movie.truncate(cycles_executed);
+        }
+        return 0;
+    }
+
+    uint64_t Chip8Emu::state_hash() const {
+        MachineState state;
+        save_state(state);
+        return hash_bytes(&state, sizeof state);
+    }
+
+    int Chip8Emu::save_state_file(std::string path) const {
+        MachineState state;
+        save_state(state);
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == NULL) {
+            std::cerr << "Could not open " << path << " for writing\n";
+            return -1;
+        }
+        size_t written = fwrite(&state, sizeof state, 1, file);
+        if (fclose(file) != 0 || written != 1) {
+            std::cerr << "Could not write state to " << path << '\n';
+            return -1;
+        }
+        return 0;
+    }
+
+    int Chip8Emu::load_state_file(std::string path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Could not open " << path << '\n';
+            return -1;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size != sizeof(MachineState)) {
+            std::cerr << path << " is not a save state\n";
+            close(fd);
+            return -1;
+        }
+        void *mapping = mmap(NULL, sizeof(MachineState), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Could not map " << path << '\n';
+            return -1;
+        }
+        int status = load_state(*static_cast<const MachineState *>(mapping));
+        munmap(mapping, sizeof(MachineState));
+        return status;
+    }
+
+    int Chip8Emu::run_state(const MachineState &state, const EmuOptions &options) {
+        runnig_program = "CHIP-8";
+        display->init(options.frontend ? options.frontend->display_backend() : nullptr);
+        if (load_state(state) != 0) {
+            return -1;
+        }
+        return run_loaded(options);
+    }
+
+}
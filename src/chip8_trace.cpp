@@ -0,0 +1,90 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <cstdio>
+
+// File layout, host byte order: u32 magic, u16 version, u16 record size, u64 record count, then the records
+struct TraceHeader {
+    u_int32_t magic;
+    u_int16_t version;
+    u_int16_t record_size;
+    u_int64_t count;
+};
+
+namespace chip8 {
+
+    Tracer::Tracer(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        ring.resize(size);
+        mask = size - 1;
+    }
+
+    int Tracer::dump(std::string path) {
+        size_t held = std::min<u_int64_t>(written, ring.size());
+        // The oldest record held is the one the next record would overwrite
+        size_t oldest = (written - held) & mask;
+        // Left out of record() to keep it a plain copy; the oldest record has nothing to compare against
+        const TraceRecord *previous = nullptr;
+        for (size_t i = 0; i < held; i++) {
+            TraceRecord &entry = ring[(oldest + i) & mask];
+            u_int16_t changed = 0;
+            for (int reg = 0; previous && reg < REG_MAX; reg++) {
+                changed |= (previous->regs[reg] != entry.regs[reg]) << reg;
+            }
+            entry.changed = changed;
+            previous = &entry;
+        }
+        TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), held};
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == NULL) {
+            std::cerr << "Could not open " << path << " for writing\n";
+            return -1;
+        }
+        bool ok = fwrite(&header, sizeof header, 1, file) == 1;
+        size_t first_part = std::min(held, ring.size() - oldest);
+        ok = ok && fwrite(&ring[oldest], sizeof(TraceRecord), first_part, file) == first_part;
+        ok = ok && fwrite(ring.data(), sizeof(TraceRecord), held - first_part, file) == held - first_part;
+        if (fclose(file) != 0 || !ok) {
+            std::cerr << "Could not write trace to " << path << '\n';
+            return -1;
+        }
+        return 0;
+    }
+
+    int read_trace(std::string path, std::vector<TraceRecord> &records) {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            std::cerr << "Could not open " << path << '\n';
+            return -1;
+        }
+        TraceHeader header;
+        if (fread(&header, sizeof header, 1, file) != 1 || header.magic != TRACE_MAGIC
+                || header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+            std::cerr << path << " is not a compatible trace\n";
+            fclose(file);
+            return -1;
+        }
+        // The count comes from the file, so it is checked against the records actually there before allocating
+        long start = ftell(file);
+        long end = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+        if (start < 0 || end < start || fseek(file, start, SEEK_SET) != 0) {
+            std::cerr << "Could not read " << path << '\n';
+            fclose(file);
+            return -1;
+        }
+        if (header.count > static_cast<u_int64_t>(end - start) / sizeof(TraceRecord)) {
+            std::cerr << path << " is truncated\n";
+            fclose(file);
+            return -1;
+        }
+        records.resize(header.count);
+        size_t got = fread(records.data(), sizeof(TraceRecord), header.count, file);
+        fclose(file);
+        if (got != header.count) {
+            std::cerr << path << " is truncated\n";
+            return -1;
+        }
+        return 0;
+    }
+
+}
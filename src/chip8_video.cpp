@@ -0,0 +1,148 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+// File layout, little-endian: "C8VD", u16 version, u16 frames per second, then per frame a u8 hires flag,
+// a u32 length and the frame's encoded difference to the previous frame (to a blank frame for the first)
+#define VIDEO_MAGIC "C8VD"
+// How long the writer sleeps when it has caught up
+#define VIDEO_WRITER_POLL std::chrono::milliseconds(2)
+
+static void put_le(std::ostream &out, u_int32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.put(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+static bool get_le(std::istream &in, u_int32_t &value, int bytes) {
+    value = 0;
+    for (int i = 0; i < bytes; i++) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= static_cast<u_int32_t>(byte) << (8 * i);
+    }
+    return true;
+}
+
+namespace chip8 {
+
+    int VideoRecorder::open(std::string path, bool drop_when_behind) {
+        this->path = path;
+        this->drop_when_behind = drop_when_behind;
+        out.open(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "Could not open " << path << " for writing\n";
+            return -1;
+        }
+        out.write(VIDEO_MAGIC, 4);
+        put_le(out, VIDEO_VERSION, 2);
+        put_le(out, FRAME_RATE, 2);
+        writer = std::thread(&VideoRecorder::write_frames, this);
+        return 0;
+    }
+
+    void VideoRecorder::capture(const Framebuffer &framebuffer, bool hires) {
+        ++captured;
+        VideoFrame frame = {framebuffer, hires};
+        while (!frames.push(frame)) {
+            if (drop_when_behind) {
+                ++dropped;
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void VideoRecorder::write_frames() {
+        VideoFrame frame;
+        VideoFrame previous = {};
+        std::vector<u_int8_t> encoded;
+        encoded.reserve(sizeof(Framebuffer) + 16);
+        for (;;) {
+            if (!frames.pop(frame)) {
+                // Everything captured before the stop request is already in the queue
+                if (stopping.load(std::memory_order_acquire)) {
+                    if (!frames.pop(frame)) break;
+                } else {
+                    std::this_thread::sleep_for(VIDEO_WRITER_POLL);
+                    continue;
+                }
+            }
+            encode_delta(reinterpret_cast<const u_int8_t *>(frame.framebuffer.data()),
+                    reinterpret_cast<const u_int8_t *>(previous.framebuffer.data()), sizeof(Framebuffer), encoded);
+            out.put(frame.hires);
+            put_le(out, encoded.size(), 4);
+            out.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+            previous = frame;
+        }
+        out.close();
+        if (!out) {
+            write_failed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    int VideoRecorder::close() {
+        if (!writer.joinable()) return 0;
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+        if (write_failed.load(std::memory_order_relaxed)) {
+            std::cerr << "Could not write video to " << path << '\n';
+            return -1;
+        }
+        return 0;
+    }
+
+    int export_video_pbm(std::string video_path, std::string prefix) {
+        std::ifstream in(video_path, std::ios::binary);
+        char magic[4];
+        u_int32_t version, frames_per_second;
+        if (!in.read(magic, 4) || std::string(magic, 4) != VIDEO_MAGIC || !get_le(in, version, 2)
+                || version != VIDEO_VERSION || !get_le(in, frames_per_second, 2)) {
+            std::cerr << video_path << " is not a compatible video recording\n";
+            return -1;
+        }
+        Framebuffer framebuffer = {};
+        std::vector<u_int8_t> encoded;
+        int hires;
+        unsigned long frame = 0;
+        while ((hires = in.get()) != EOF) {
+            u_int32_t size;
+            // A difference never takes more than a literal run of every byte plus its two run lengths
+            if (!get_le(in, size, 4) || size > sizeof(Framebuffer) + 16) {
+                std::cerr << video_path << " is truncated at frame " << frame << '\n';
+                return -1;
+            }
+            encoded.resize(size);
+            if (!in.read(reinterpret_cast<char *>(encoded.data()), size)) {
+                std::cerr << video_path << " is truncated at frame " << frame << '\n';
+                return -1;
+            }
+            if (!apply_delta(encoded.data(), size, reinterpret_cast<u_int8_t *>(framebuffer.data()),
+                    sizeof(Framebuffer))) {
+                std::cerr << video_path << " is corrupt at frame " << frame << '\n';
+                return -1;
+            }
+            std::ostringstream name;
+            name << prefix << std::setw(6) << std::setfill('0') << frame << ".pbm";
+            std::ofstream image(name.str(), std::ios::binary);
+            int width = hires ? SCREEN_WIDTH : LORES_WIDTH;
+            int height = hires ? SCREEN_HEIGHT : LORES_HEIGHT;
+            image << "P4\n" << width << ' ' << height << '\n';
+            for (int y = 0; y < height; y++) {
+                PixelRow row = framebuffer[0][y] | framebuffer[1][y];
+                for (int byte = 0; byte < width / 8; byte++) {
+                    image.put(static_cast<char>(row >> (SCREEN_WIDTH - 8 - 8 * byte)));
+                }
+            }
+            if (!image) {
+                std::cerr << "Could not write " << name.str() << '\n';
+                return -1;
+            }
+            ++frame;
+        }
+        std::cerr << "Wrote " << frame << " frames\n";
+        return 0;
+    }
+
+}
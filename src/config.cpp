@@ -1,34 +1,144 @@
 #include "config.hpp"
+#include <climits>
 #include <fstream>
+#include <iostream>
 
 namespace ch8cfg {
 
+    // A setting of the wrong type is reported and replaced by the default
+    template <typename T>
+    static T setting(const nlohmann::json &data, const char *key, T fallback) {
+        try {
+            return data.value(key, fallback);
+        } catch (const nlohmann::json::type_error &error) {
+            std::cerr << "Invalid " << key << " in config.json, using the default: " << error.what() << '\n';
+            return fallback;
+        }
+    }
+
+    // An integer setting within [min, max]; anything else is reported and replaced by the default
+    static long checked_value(const nlohmann::json &data, const char *key, long fallback, long min, long max) {
+        long value = setting(data, key, fallback);
+        if (value < min || value > max) {
+            std::cerr << "Invalid " << key << " in config.json, using " << fallback << ": " << value << '\n';
+            return fallback;
+        }
+        return value;
+    }
+
+    static nlohmann::json default_json() {
+        return {
+            {"scale", 10},
+            {"phosphor", 0.0},
+            {"freq", 540},
+            {"cycles_per_frame", 0},
+            {"backend", "sdl"},
+            {"engine", "interpreter"},
+            {"rewind_seconds", 30},
+            {"seed", 1},
+            {"quirks", "modern"},
+            {"idle_skip", true},
+            {"audio", true},
+            {"audio_buffer", 512},
+            {"rom_quirks", nlohmann::json::object()},
+            {"rom_database", "roms.json"}
+        };
+    }
+
+    // -1 when there is no config file, -2 when it could not be parsed or is not an object
     int Config::parse_json() {
         std::ifstream config("config.json");
-        if (config.good()) {
-            data = nlohmann::json::parse(config);
-        } else {
+        if (!config.good()) {
             return -1;
         }
-        config.close();
+        try {
+            data = nlohmann::json::parse(config);
+        } catch (const nlohmann::json::exception &error) {
+            std::cerr << "Could not parse config.json, using defaults: " << error.what() << '\n';
+            return -2;
+        }
+        if (!data.is_object()) {
+            std::cerr << "config.json is not an object, using defaults\n";
+            return -2;
+        }
         return 0;
     }
 
     void Config::write_json() {
         std::ofstream config("config.json");
-        data = {
-            {"scale", 10},
-            {"freq", 540}
-        };
         config << std::setw(4) << data << std::endl;
         config.close();
     }
 
     Config::Config() {
-        if (parse_json() != 0)
-            write_json();
-        disp_scale = data["scale"];
-        cpu_freq = data["freq"];
+        int status = parse_json();
+        if (status != 0) {
+            data = default_json();
+            // A config that failed to parse is left alone for the user to fix
+            if (status == -1)
+                write_json();
+        }
+        // The same ranges the command line accepts
+        disp_scale = checked_value(data, "scale", 10, 1, SHRT_MAX);
+        phosphor = setting(data, "phosphor", 0.0);
+        cpu_freq = checked_value(data, "freq", 540, 0, SHRT_MAX);
+        backend = setting<std::string>(data, "backend", "sdl");
+        engine = setting<std::string>(data, "engine", "interpreter");
+        rewind_seconds = checked_value(data, "rewind_seconds", 30, 0, SHRT_MAX);
+        cycles_per_frame = checked_value(data, "cycles_per_frame", 0, 0, SHRT_MAX);
+        seed = setting(data, "seed", 1u);
+        quirks = setting<std::string>(data, "quirks", "modern");
+        idle_skip = setting(data, "idle_skip", true);
+        audio = setting(data, "audio", true);
+        audio_buffer = checked_value(data, "audio_buffer", 512, 1, 32768);
+        if (audio_buffer & (audio_buffer - 1)) {
+            std::cerr << "Invalid audio_buffer in config.json, expected a power of two, using 512: " << audio_buffer << '\n';
+            audio_buffer = 512;
+        }
+        rom_quirks = setting(data, "rom_quirks", std::map<std::string, std::string>());
+        load_rom_database(setting<std::string>(data, "rom_database", "roms.json"));
+    }
+
+    std::string Config::quirks_for(std::string program) const {
+        std::string name = program.substr(program.find_last_of('/') + 1);
+        auto found = rom_quirks.find(name);
+        return found != rom_quirks.end() ? found->second : quirks;
+    }
+
+    // The database is an object from the ROM hash, in hex, to its profile:
+    // {"name": ..., "cycles_per_frame": N, "quirks": ..., "keys": [16 key names], "palette": ["#RRGGBB", ...]}
+    void Config::load_rom_database(std::string path) {
+        std::ifstream database(path);
+        if (!database.good()) {
+            return;
+        }
+        try {
+            nlohmann::json entries = nlohmann::json::parse(database);
+            for (auto &entry : entries.items()) {
+                const nlohmann::json &fields = entry.value();
+                RomProfile profile;
+                profile.name = fields.value("name", entry.key());
+                int cycles_per_frame = fields.value("cycles_per_frame", 0);
+                if (cycles_per_frame < 0 || cycles_per_frame > SHRT_MAX) {
+                    throw std::out_of_range("cycles_per_frame of " + profile.name + " is out of range");
+                }
+                profile.cycles_per_frame = cycles_per_frame;
+                profile.quirks = fields.value("quirks", "");
+                profile.keys = fields.value("keys", std::vector<std::string>());
+                for (const std::string &colour : fields.value("palette", std::vector<std::string>())) {
+                    profile.palette.push_back(0xFF000000 | std::stoul(colour.substr(colour.find('#') + 1), nullptr, 16));
+                }
+                rom_profiles[std::stoull(entry.key(), nullptr, 16)] = profile;
+            }
+        } catch (const std::exception &error) {
+            std::cerr << "Could not read ROM database " << path << ": " << error.what() << '\n';
+            rom_profiles.clear();
+        }
+    }
+
+    const RomProfile *Config::rom_profile(uint64_t rom_hash) const {
+        auto found = rom_profiles.find(rom_hash);
+        return found != rom_profiles.end() ? &found->second : NULL;
     }
 
 }
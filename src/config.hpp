@@ -2,18 +2,53 @@
 #define CONFIG_H
 
 #include <nlohmann/json.hpp>
+#include <string>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
 
 namespace ch8cfg {
 
+    // Settings for one ROM from the ROM database; empty or zero fields are left to the global config
+    struct RomProfile {
+        std::string name;
+        short cycles_per_frame = 0;
+        std::string quirks;
+        // SDL key names for CHIP-8 keys 0-F
+        std::vector<std::string> keys;
+        // ARGB colours for each pixel value
+        std::vector<uint32_t> palette;
+    };
+
     class Config {
         public:
             Config();
             short disp_scale;
+            // Fraction of the last frame's colour kept each frame
+            double phosphor;
             short cpu_freq;
+            short cycles_per_frame;
+            std::string backend;
+            std::string engine;
+            short rewind_seconds;
+            unsigned seed;
+            std::string quirks;
+            bool audio;
+            bool idle_skip;
+            int audio_buffer;
+            // Quirk profile overrides keyed by ROM file name
+            std::map<std::string, std::string> rom_quirks;
+            std::string quirks_for(std::string program) const;
+            // The database entry for a ROM, by the FNV-1a hash of its bytes; NULL if it has none
+            const RomProfile *rom_profile(uint64_t rom_hash) const;
         private:
             nlohmann::json data;
+            // Loaded once from the file named by rom_database
+            std::unordered_map<uint64_t, RomProfile> rom_profiles;
             int parse_json();
             void write_json();
+            void load_rom_database(std::string path);
     };
 
 }
@@ -1,33 +1,362 @@
-#include "chip8.hpp"
+#include "chip8_sdl.hpp"
 #include "config.hpp"
 #include <iostream>
+#include <fstream>
+#include <iterator>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
 
-int main(int argc, char *argv[]) {
-    chip8::Chip8Emu *emulator = new chip8::Chip8Emu();
-    if (argc < 2) {
-        std::cerr << "Usage: dummy.out PROGRAM.ch8 [Display Scaling Factor] [CPU Frequency (Hz)]\n";
+#define DEFAULT_BATCH_CYCLES 1000000
+
+// Runs the program headless on both engines and checks they end in the same state
+int verify_engines(std::string program, chip8::EmuOptions options, unsigned long cycles) {
+    chip8::Chip8Emu interpreted, translated;
+    options.frontend = nullptr;
+    options.cycle_limit = cycles;
+    options.engine = chip8::ENGINE_INTERPRETER;
+    if (interpreted.run_program(program, options) != 0) return -1;
+    options.engine = chip8::ENGINE_BLOCKS;
+    if (translated.run_program(program, options) != 0) return -1;
+    if (!interpreted.same_state(translated)) {
+        std::cerr << "Engines diverged within " << cycles << " cycles\n";
+        return 1;
+    }
+    std::cout << "Engines agree after " << cycles << " cycles\n";
+    return 0;
+}
+
+int parse_quirks(std::string name, chip8::QuirkProfile &profile) {
+    if (name == "modern") {
+        profile = chip8::QUIRKS_MODERN;
+    } else if (name == "vip") {
+        profile = chip8::QUIRKS_VIP;
+    } else if (name == "chip48") {
+        profile = chip8::QUIRKS_CHIP48;
+    } else if (name == "schip") {
+        profile = chip8::QUIRKS_SCHIP;
+    } else if (name == "xochip") {
+        profile = chip8::QUIRKS_XOCHIP;
+    } else {
+        std::cerr << "Unknown quirk profile: " << name << '\n';
         return -1;
     }
+    return 0;
+}
+
+// Same hash the emulator keys recordings with; 0 if the file cannot be read
+uint64_t rom_hash(std::string program) {
+    std::ifstream file(program, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return bytes.empty() ? 0 : chip8::hash_bytes(bytes.data(), bytes.size());
+}
+
+int main(int argc, char *argv[]) {
+    chip8::Chip8Emu emulator;
     ch8cfg::Config config;
-    if (argc >= 3) {
-        std::istringstream ss(argv[2]);
+    chip8::EmuOptions options;
+    chip8::KeyMap key_map = chip8::DEFAULT_KEY_MAP;
+    std::vector<char *> args;
+    unsigned long verify_cycles = 0;
+    std::string batch_list;
+    std::string corpus_path;
+    std::string export_video;
+    std::string export_prefix;
+    std::string quirks;
+    short cycles_per_frame = 0;
+    bool print_hash = false;
+    // -1 follows the config for SDL runs and stays silent for headless ones
+    int audio = -1;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            config.backend = "headless";
+        } else if (arg == "--cycles" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> options.cycle_limit)) {
+                std::cerr << "Invalid argument for cycle limit: " << argv[i] << '\n';
+                return -1;
+            }
+        } else if (arg == "--engine" && i + 1 < argc) {
+            config.engine = argv[++i];
+        } else if (arg == "--cycles-per-frame" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> cycles_per_frame) || cycles_per_frame <= 0) {
+                std::cerr << "Invalid argument for cycles per frame: " << argv[i] << '\n';
+                return -1;
+            }
+        } else if (arg == "--rom-hash") {
+            print_hash = true;
+        } else if (arg == "--quirks" && i + 1 < argc) {
+            quirks = argv[++i];
+        } else if (arg == "--verify-engines" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> verify_cycles) || verify_cycles == 0) {
+                std::cerr << "Invalid argument for verification cycles: " << argv[i] << '\n';
+                return -1;
+            }
+        } else if (arg == "--load-state" && i + 1 < argc) {
+            options.state_file = argv[++i];
+            options.resume_from_state = true;
+        } else if (arg == "--state-file" && i + 1 < argc) {
+            options.state_file = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> config.seed)) {
+                std::cerr << "Invalid argument for random seed: " << argv[i] << '\n';
+                return -1;
+            }
+        } else if (arg == "--record" && i + 1 < argc) {
+            options.record_file = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            options.replay_file = argv[++i];
+            config.backend = "headless";
+        } else if (arg == "--profile" && i + 1 < argc) {
+            options.profile_file = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.trace_file = argv[++i];
+        } else if (arg == "--trace-records" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> options.trace_records) || options.trace_records == 0) {
+                std::cerr << "Invalid argument for trace records: " << argv[i] << '\n';
+                return -1;
+            }
+        } else if (arg == "--debug") {
+            options.debug = true;
+        } else if (arg == "--debug-socket" && i + 1 < argc) {
+            options.debug_socket = argv[++i];
+        } else if (arg == "--no-idle-skip") {
+            config.idle_skip = false;
+        } else if (arg == "--audio") {
+            audio = 1;
+        } else if (arg == "--no-audio") {
+            audio = 0;
+        } else if (arg == "--audio-buffer" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> config.audio_buffer) || config.audio_buffer <= 0 || config.audio_buffer > 32768
+                    || (config.audio_buffer & (config.audio_buffer - 1))) {
+                std::cerr << "Invalid argument for audio buffer, expected a power of two: " << argv[i] << '\n';
+                return -1;
+            }
+        } else if (arg == "--phosphor" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> config.phosphor)) {
+                std::cerr << "Invalid argument for phosphor persistence: " << argv[i] << '\n';
+                return -1;
+            }
+        } else if (arg == "--video" && i + 1 < argc) {
+            options.video_file = argv[++i];
+        } else if (arg == "--export-video" && i + 2 < argc) {
+            export_video = argv[++i];
+            export_prefix = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_list = argv[++i];
+        } else if (arg == "--corpus" && i + 1 < argc) {
+            corpus_path = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            std::istringstream ss(argv[++i]);
+            if (!(ss >> threads) || threads == 0) {
+                std::cerr << "Invalid argument for thread count: " << argv[i] << '\n';
+                return -1;
+            }
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (!export_video.empty()) {
+        return chip8::export_video_pbm(export_video, export_prefix);
+    }
+    if (args.size() < 1 && batch_list.empty() && corpus_path.empty()) {
+        std::cerr << "Usage: dummy.out [--headless] [--cycles N] [--cycles-per-frame N] [--engine NAME] [--quirks NAME]\n";
+        std::cerr << "                 [--seed N] [--no-idle-skip] [--verify-engines N]\n";
+        std::cerr << "                 [--load-state FILE] [--state-file FILE] [--record FILE | --replay FILE]\n";
+        std::cerr << "                 [--profile FILE] [--trace FILE] [--trace-records N] [--debug | --debug-socket PATH]\n";
+        std::cerr << "                 [--audio | --no-audio] [--audio-buffer N] [--phosphor F] [--video FILE]\n";
+        std::cerr << "                 PROGRAM.ch8 [Display Scaling Factor] [CPU Frequency (Hz)]\n";
+        std::cerr << "       dummy.out --rom-hash PROGRAM.ch8\n";
+        std::cerr << "       dummy.out --export-video FILE PREFIX\n";
+        std::cerr << "       dummy.out (--batch JOBS.txt | --corpus DIR|ARCHIVE.tar|-) [--threads N] [--cycles N]\n";
+        std::cerr << "                 [--engine NAME] [--quirks NAME]\n";
+        return -1;
+    }
+    if (args.size() >= 2) {
+        std::istringstream ss(args[1]);
         if ((ss >> config.disp_scale) && (config.disp_scale >= 1)) {
             // OK
         } else {
-            std::cerr << "Invalid argument for scaling factor: " << argv[2] << '\n';
+            std::cerr << "Invalid argument for scaling factor: " << args[1] << '\n';
             return -1;
         }
     }
-    if (argc >= 4) {
-        std::istringstream ss(argv[3]);
+    if (args.size() >= 3) {
+        std::istringstream ss(args[2]);
         if ((ss >> config.cpu_freq) && (config.cpu_freq >= 0)) {
             // OK
         } else {
-            std::cerr << "Invalid argument for cpu frequency: " << argv[3] << '\n';
+            std::cerr << "Invalid argument for cpu frequency: " << args[2] << '\n';
             return -1;
         }
     }
-    emulator->run_program(argv[1], config.disp_scale, config.cpu_freq);
+    // The ROM database entry applies over the global config, and the command line over both
+    std::string cli_quirks = quirks;
+    uint64_t hash = args.empty() ? 0 : rom_hash(args[0]);
+    if (print_hash) {
+        std::cout << std::hex << hash << std::dec << '\n';
+        return hash ? 0 : -1;
+    }
+    const ch8cfg::RomProfile *profile = config.rom_profile(hash);
+    if (profile) {
+        std::cerr << "Using ROM profile " << profile->name << '\n';
+        // A frequency given on the command line replaces the profile's rate
+        if (profile->cycles_per_frame && args.size() < 3) {
+            config.cycles_per_frame = profile->cycles_per_frame;
+        }
+        if (quirks.empty()) {
+            quirks = profile->quirks;
+        }
+        if (!profile->keys.empty()) {
+            if (profile->keys.size() != 16) {
+                std::cerr << "ROM profile " << profile->name << " must map all 16 keys\n";
+                return -1;
+            }
+            for (int key = 0; key < 16; key++) {
+                key_map[key] = SDL_GetScancodeFromName(profile->keys[key].c_str());
+                if (key_map[key] == SDL_SCANCODE_UNKNOWN) {
+                    std::cerr << "Unknown key name in ROM profile " << profile->name << ": " << profile->keys[key]
+                        << '\n';
+                    return -1;
+                }
+            }
+        }
+        for (size_t value = 0; value < profile->palette.size() && value < options.palette.size(); value++) {
+            options.palette[value] = profile->palette[value];
+        }
+    }
+    if (cycles_per_frame) {
+        config.cycles_per_frame = cycles_per_frame;
+    }
+    if (config.phosphor < 0 || config.phosphor >= 1) {
+        std::cerr << "Phosphor persistence must be at least 0 and below 1: " << config.phosphor << '\n';
+        return -1;
+    }
+    bool window;
+    if (config.backend == "sdl") {
+        window = true;
+    } else if (config.backend == "headless") {
+        window = false;
+    } else {
+        std::cerr << "Unknown display backend: " << config.backend << '\n';
+        return -1;
+    }
+    if (config.engine == "interpreter") {
+        options.engine = chip8::ENGINE_INTERPRETER;
+    } else if (config.engine == "blocks") {
+        options.engine = chip8::ENGINE_BLOCKS;
+    } else {
+        std::cerr << "Unknown execution engine: " << config.engine << '\n';
+        return -1;
+    }
+    if (quirks.empty()) {
+        quirks = args.empty() ? config.quirks : config.quirks_for(args[0]);
+    }
+    if (parse_quirks(quirks, options.quirks) != 0) {
+        return -1;
+    }
+    options.cpu_freq = config.cpu_freq;
+    options.cycles_per_frame = config.cycles_per_frame;
+    options.rewind_seconds = config.rewind_seconds;
+    options.seed = config.seed;
+    bool play_audio = audio == -1 ? config.audio && window : audio == 1;
+    options.skip_idle = config.idle_skip;
+    if (!options.record_file.empty() && !options.replay_file.empty()) {
+        std::cerr << "Cannot record and replay at the same time\n";
+        return -1;
+    }
+    if (options.resume_from_state && !(options.record_file.empty() && options.replay_file.empty())) {
+        std::cerr << "Recordings start from power-on and cannot resume a save state\n";
+        return -1;
+    }
+    if (!batch_list.empty() || !corpus_path.empty()) {
+        if (!options.profile_file.empty() || !options.video_file.empty() || !options.trace_file.empty()
+                || options.debug || !options.debug_socket.empty() || !options.record_file.empty()
+                || !options.replay_file.empty()) {
+            std::cerr << "Profiling, tracing, debugging, input recording and replay, and video recording are not"
+                " supported for batch runs\n";
+            return -1;
+        }
+        std::vector<chip8::BatchJob> jobs;
+        unsigned long default_budget = options.cycle_limit ? options.cycle_limit : DEFAULT_BATCH_CYCLES;
+        chip8::RomCorpus corpus;
+        if (!corpus_path.empty()) {
+            if (corpus.open(corpus_path) != 0) {
+                return -1;
+            }
+            chip8::corpus_batch_jobs(corpus, default_budget, jobs);
+        }
+        if (!batch_list.empty() && chip8::read_batch_jobs(batch_list, default_budget, jobs) != 0) {
+            return -1;
+        }
+        // Each job gets its own ROM database entry and rom_quirks, below the command line as for a single run
+        for (chip8::BatchJob &job : jobs) {
+            const ch8cfg::RomProfile *job_profile =
+                config.rom_profile(job.rom_hash ? job.rom_hash : rom_hash(job.program));
+            if (job_profile && job_profile->cycles_per_frame && !cycles_per_frame) {
+                job.cycles_per_frame = job_profile->cycles_per_frame;
+            }
+            if (cli_quirks.empty()) {
+                chip8::QuirkProfile job_quirks;
+                std::string name = job_profile && !job_profile->quirks.empty() ? job_profile->quirks
+                    : config.quirks_for(job.program);
+                if (parse_quirks(name, job_quirks) != 0) {
+                    return -1;
+                }
+                job.quirks = job_quirks;
+            }
+        }
+        auto start = Clock::now();
+        std::vector<chip8::BatchResult> results = chip8::run_batch(jobs, options, threads);
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        chip8::print_batch_results(std::cout, jobs, results);
+        unsigned long total_cycles = 0;
+        for (const chip8::BatchResult &result : results) {
+            total_cycles += result.cycles;
+        }
+        std::cerr << jobs.size() << " jobs on " << threads << " threads in " << elapsed << "s, "
+            << (total_cycles / elapsed / 1e6) << " MIPS total\n";
+        return 0;
+    }
+    if (verify_cycles) {
+        return verify_engines(args[0], options, verify_cycles);
+    }
+    // Runs with a window or sound are shown and paced; the rest are headless
+    chip8::SdlFrontend frontend;
+    if (window || play_audio) {
+        frontend.set_key_map(key_map);
+        if (frontend.open(args[0], window, config.disp_scale, config.phosphor,
+                play_audio ? config.audio_buffer : 0) != 0) {
+            return -1;
+        }
+        if (frontend.has_window() || frontend.has_audio()) {
+            options.frontend = &frontend;
+        }
+    }
+    if (!options.replay_file.empty()) {
+        if (emulator.run_program(args[0], options) != 0) {
+            return -1;
+        }
+        std::cout << "Replayed " << emulator.cycles_run() << " cycles, framebuffer "
+            << std::hex << chip8::hash_bytes(emulator.framebuffer().data(), sizeof(chip8::Framebuffer))
+            << ", state " << emulator.state_hash() << std::dec << '\n';
+        return 0;
+    }
+    // Without a window nothing is left to watch once the program halts, so the run ends there
+    if (!frontend.has_window()) {
+        options.stop_on_halt = true;
+    }
+    if (emulator.run_program(args[0], options) != 0) {
+        return -1;
+    }
     return 0;
 }
@@ -0,0 +1,75 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+/* C interface to the emulator core, for embedding in test harnesses and bindings such as ctypes.
+ * Machines are independent of each other and need no SDL; each one must only be used from one thread at a time. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a signature or the layout of chip8_config changes */
+#define CHIP8_API_VERSION 1
+
+enum chip8_quirks {
+    CHIP8_QUIRKS_MODERN, CHIP8_QUIRKS_VIP, CHIP8_QUIRKS_CHIP48, CHIP8_QUIRKS_SCHIP, CHIP8_QUIRKS_XOCHIP
+};
+
+enum chip8_engine {
+    CHIP8_ENGINE_INTERPRETER, CHIP8_ENGINE_BLOCKS
+};
+
+typedef struct chip8_config {
+    int cycles_per_frame;       /* Instructions per 60Hz frame, 1 to 32767 */
+    int quirks;                 /* One of chip8_quirks */
+    int engine;                 /* One of chip8_engine */
+    uint32_t seed;              /* Seed for CXNN's random numbers */
+    int skip_idle;              /* Skip idle loops; results are the same either way */
+    int stop_on_halt;           /* Make the run functions return 1 once the program jumps to itself */
+} chip8_config;
+
+typedef struct chip8_machine chip8_machine;
+
+int chip8_api_version(void);
+/* 9 instructions per frame (540Hz), modern quirks, the interpreter, seed 1, idle skipping, no stop on halt */
+void chip8_default_config(chip8_config *config);
+
+/* NULL config takes the defaults. Returns NULL on failure. */
+chip8_machine *chip8_create(const chip8_config *config);
+void chip8_destroy(chip8_machine *machine);
+
+/* Copies the program to 0x200 on a machine reset to its power-on state, so loading again starts over with the
+ * new program. 0 on success, -1 on failure. */
+int chip8_load_rom(chip8_machine *machine, const uint8_t *rom, size_t size);
+
+/* Run instructions, or whole frames, with the timers ticking at frame boundaries; a run split into steps of any
+ * size ends in the same state. 0 on success, 1 once the program halted (with stop_on_halt), -1 on errors and
+ * before a ROM was loaded. */
+int chip8_run_cycles(chip8_machine *machine, unsigned long cycles);
+int chip8_run_frames(chip8_machine *machine, unsigned long frames);
+
+/* Bit N set while key N is down; applies from the next instruction */
+void chip8_set_keys(chip8_machine *machine, uint16_t mask);
+
+/* One byte per pixel, row by row, holding the pixel value (bit N from plane N). The screen is 64x32 in low
+ * resolution and 128x64 in high resolution; width and height may be NULL. The pointer stays valid until the next
+ * call on the machine. */
+const uint8_t *chip8_framebuffer(chip8_machine *machine, int *width, int *height);
+/* Hash of the packed framebuffer, the same one batch runs and replays print */
+uint64_t chip8_framebuffer_hash(const chip8_machine *machine);
+
+unsigned long chip8_cycles(const chip8_machine *machine);
+/* Copies V0-VF into regs, which must hold 16 bytes */
+void chip8_registers(const chip8_machine *machine, uint8_t *regs);
+/* PC as an address in memory */
+uint16_t chip8_pc(const chip8_machine *machine);
+uint16_t chip8_index(const chip8_machine *machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
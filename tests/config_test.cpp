@@ -0,0 +1,65 @@
+#include "config.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// Reads config files with settings of the wrong type, out of range and not an object at all, and checks that each
+// such setting falls back to its default while the valid ones are kept
+
+static void write_config(const std::string &text) {
+    std::ofstream out("config.json");
+    out << text;
+}
+
+static int check(bool ok, const char *what) {
+    if (!ok) {
+        std::cerr << "Failed: " << what << '\n';
+    }
+    return !ok;
+}
+
+int main() {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "chip8_config_test";
+    std::filesystem::create_directories(dir);
+    std::filesystem::current_path(dir);
+    int failures = 0;
+
+    write_config(R"({"scale": "3", "freq": 1000, "backend": 5, "engine": "blocks", "idle_skip": "no",
+                     "phosphor": [0.5], "rom_quirks": {"a.ch8": 1}, "seed": 7, "rom_database": false})");
+    {
+        ch8cfg::Config config;
+        failures += check(config.disp_scale == 10, "a string scale falls back to 10");
+        failures += check(config.cpu_freq == 1000, "freq is kept");
+        failures += check(config.backend == "sdl", "a number backend falls back to sdl");
+        failures += check(config.engine == "blocks", "engine is kept");
+        failures += check(config.idle_skip, "a string idle_skip falls back to true");
+        failures += check(config.phosphor == 0.0, "an array phosphor falls back to 0");
+        failures += check(config.rom_quirks.empty(), "rom_quirks with a number falls back to none");
+        failures += check(config.seed == 7, "seed is kept");
+    }
+
+    write_config(R"({"scale": 0, "cycles_per_frame": 40000, "audio_buffer": 300})");
+    {
+        ch8cfg::Config config;
+        failures += check(config.disp_scale == 10, "scale 0 falls back to 10");
+        failures += check(config.cycles_per_frame == 0, "cycles_per_frame past a short falls back to 0");
+        failures += check(config.audio_buffer == 512, "an audio_buffer that is no power of two falls back to 512");
+    }
+
+    write_config("[1, 2, 3]");
+    {
+        ch8cfg::Config config;
+        failures += check(config.disp_scale == 10 && config.quirks == "modern", "an array config uses defaults");
+    }
+    std::ifstream kept("config.json");
+    std::string text((std::istreambuf_iterator<char>(kept)), std::istreambuf_iterator<char>());
+    failures += check(text == "[1, 2, 3]", "a config that is not an object is left alone");
+
+    std::filesystem::current_path(dir.parent_path());
+    std::filesystem::remove_all(dir);
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
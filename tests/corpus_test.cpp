@@ -0,0 +1,127 @@
+#include "chip8.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writes the same ROMs as a directory and as a tar archive, and checks that both index the bytes of each file, in
+// name order for the directory and archive order for the archive, skipping what is not a ROM, and that an archive
+// cut short is rejected
+
+struct RomFile {
+    std::string name;
+    std::vector<u_int8_t> bytes;
+};
+
+static std::vector<RomFile> roms() {
+    std::vector<RomFile> files = {{"pong.ch8", {}}, {"blinky.ch8", {}}, {"tiny.ch8", {0x12, 0x00}}};
+    // Sizes that are not whole tar blocks, and one spanning several
+    for (int i = 0; i < 700; i++) files[0].bytes.push_back(i * 7);
+    for (int i = 0; i < 1500; i++) files[1].bytes.push_back(i ^ 0x5A);
+    return files;
+}
+
+static void write_file(const std::filesystem::path &path, const std::vector<u_int8_t> &bytes) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+// A ustar header: name, size in octal, type, and the magic; the index does not check the checksum
+static void tar_entry(std::vector<u_int8_t> &tar, const std::string &name, char type,
+        const std::vector<u_int8_t> &bytes) {
+    std::vector<u_int8_t> header(512, 0);
+    std::memcpy(&header[0], name.data(), name.size());
+    std::snprintf(reinterpret_cast<char *>(&header[124]), 12, "%011zo", bytes.size());
+    header[156] = type;
+    std::memcpy(&header[257], "ustar", 6);
+    tar.insert(tar.end(), header.begin(), header.end());
+    tar.insert(tar.end(), bytes.begin(), bytes.end());
+    tar.resize((tar.size() + 511) / 512 * 512, 0);
+}
+
+static int check_entries(const char *what, const chip8::RomCorpus &corpus, const std::vector<RomFile> &expected) {
+    const std::vector<chip8::CorpusEntry> &entries = corpus.entries();
+    if (entries.size() != expected.size()) {
+        std::cerr << what << " indexed " << entries.size() << " ROMs instead of " << expected.size() << '\n';
+        return 1;
+    }
+    int failures = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const chip8::CorpusEntry &entry = entries[i];
+        const std::vector<u_int8_t> &bytes = expected[i].bytes;
+        if (entry.name != expected[i].name || entry.size != bytes.size()
+                || std::memcmp(corpus.rom(entry), bytes.data(), bytes.size()) != 0
+                || entry.hash != chip8::hash_bytes(bytes.data(), bytes.size())) {
+            std::cerr << what << " entry " << i << ", " << entry.name << ", does not match " << expected[i].name
+                << '\n';
+            failures++;
+        }
+    }
+    std::vector<chip8::BatchJob> jobs;
+    chip8::corpus_batch_jobs(corpus, 1000, jobs);
+    for (size_t i = 0; i < jobs.size() && i < entries.size(); i++) {
+        if (jobs[i].rom != corpus.rom(entries[i]) || jobs[i].rom_size != entries[i].size) {
+            std::cerr << what << " job " << i << " does not run its ROM\n";
+            failures++;
+        }
+    }
+    return failures + (jobs.size() != entries.size());
+}
+
+int main() {
+    int failures = 0;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "chip8_corpus_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "roms" / "subdir");
+    std::vector<RomFile> files = roms();
+
+    // Hidden, empty and nested files are not ROMs of the directory
+    for (const RomFile &file : files) write_file(dir / "roms" / file.name, file.bytes);
+    write_file(dir / "roms" / ".hidden.ch8", {0x00, 0xE0});
+    write_file(dir / "roms" / "empty.ch8", {});
+    write_file(dir / "roms" / "subdir" / "nested.ch8", {0x00, 0xE0});
+    chip8::RomCorpus directory;
+    if (directory.open((dir / "roms").string()) != 0) {
+        std::cerr << "The directory did not open\n";
+        failures++;
+    } else {
+        std::vector<RomFile> sorted = files;
+        std::sort(sorted.begin(), sorted.end(), [](const RomFile &a, const RomFile &b) { return a.name < b.name; });
+        failures += check_entries("The directory", directory, sorted);
+    }
+
+    // Directories and empty files are not ROMs of the archive
+    std::vector<u_int8_t> tar;
+    tar_entry(tar, "subdir/", '5', {});
+    for (const RomFile &file : files) tar_entry(tar, file.name, '0', file.bytes);
+    tar_entry(tar, "empty.ch8", '0', {});
+    tar.resize(tar.size() + 1024, 0);
+    write_file(dir / "roms.tar", tar);
+    chip8::RomCorpus archive;
+    if (archive.open((dir / "roms.tar").string()) != 0) {
+        std::cerr << "The archive did not open\n";
+        failures++;
+    } else {
+        failures += check_entries("The archive", archive, files);
+    }
+
+    // Cut inside the data of the second ROM
+    std::vector<u_int8_t> truncated(tar.begin(), tar.begin() + 512 + 512 + 1024 + 512 + 100);
+    write_file(dir / "truncated.tar", truncated);
+    chip8::RomCorpus cut;
+    if (cut.open((dir / "truncated.tar").string()) != -1) {
+        std::cerr << "An archive cut short opened\n";
+        failures++;
+    }
+
+    std::filesystem::remove_all(dir);
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "chip8.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Round-trips XOR differences through encode_delta and apply_delta, and checks that differences cut short, running
+// past the data or with bytes left over are rejected, also when they come from a video recording
+
+#define DATA_SIZE 300
+
+static std::vector<u_int8_t> varints(std::vector<size_t> values) {
+    std::vector<u_int8_t> bytes;
+    for (size_t value : values) {
+        for (; value >= 0x80; value >>= 7) bytes.push_back((value & 0x7F) | 0x80);
+        bytes.push_back(value);
+    }
+    return bytes;
+}
+
+static int check_round_trips() {
+    std::mt19937 random(8);
+    int failures = 0;
+    for (int round = 0; round < 200; round++) {
+        std::vector<u_int8_t> base(DATA_SIZE), current(DATA_SIZE);
+        for (u_int8_t &byte : base) byte = random();
+        current = base;
+        // From a few scattered changes up to most bytes changed
+        for (int change = 0; change < round * 2; change++) {
+            current[random() % DATA_SIZE] = random();
+        }
+        std::vector<u_int8_t> encoded;
+        chip8::encode_delta(current.data(), base.data(), DATA_SIZE, encoded);
+        std::vector<u_int8_t> decoded = base;
+        if (!chip8::apply_delta(encoded.data(), encoded.size(), decoded.data(), DATA_SIZE) || decoded != current) {
+            std::cerr << "Round trip " << round << " did not restore the data\n";
+            failures++;
+        }
+        // Every shorter prefix is cut short somewhere
+        for (size_t length = 0; length < encoded.size(); length++) {
+            std::vector<u_int8_t> truncated(encoded.begin(), encoded.begin() + length);
+            decoded = base;
+            if (chip8::apply_delta(truncated.data(), truncated.size(), decoded.data(), DATA_SIZE)) {
+                std::cerr << "Round trip " << round << " accepted a difference cut to " << length << " bytes\n";
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+static int check_rejected(const char *what, std::vector<u_int8_t> encoded) {
+    std::vector<u_int8_t> data(DATA_SIZE);
+    // Guard bytes after the data must survive
+    data.resize(DATA_SIZE + 16, 0xAA);
+    if (chip8::apply_delta(encoded.data(), encoded.size(), data.data(), DATA_SIZE)) {
+        std::cerr << "Accepted " << what << '\n';
+        return 1;
+    }
+    for (size_t i = DATA_SIZE; i < data.size(); i++) {
+        if (data[i] != 0xAA) {
+            std::cerr << "Wrote past the data for " << what << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int check_oversized() {
+    int failures = 0;
+    std::vector<u_int8_t> literals_past_end = varints({DATA_SIZE - 2, 4});
+    literals_past_end.insert(literals_past_end.end(), 4, 0xFF);
+    failures += check_rejected("a literal run past the data", literals_past_end);
+    failures += check_rejected("a zero run past the data", varints({DATA_SIZE + 1, 0}));
+    failures += check_rejected("a run length overflowing", varints({SIZE_MAX, 2, 1, 1}));
+    failures += check_rejected("a varint too long for a size", std::vector<u_int8_t>(12, 0xFF));
+    std::vector<u_int8_t> literals_past_input = varints({0, 8});
+    literals_past_input.push_back(0xFF);
+    failures += check_rejected("literals past the end of the input", literals_past_input);
+    std::vector<u_int8_t> left_over = varints({DATA_SIZE, 0, 0, 0});
+    failures += check_rejected("bytes left over", left_over);
+    return failures;
+}
+
+// A video recording of one frame with the given difference
+static std::string write_video(const std::filesystem::path &path, const std::vector<u_int8_t> &encoded) {
+    std::ofstream out(path, std::ios::binary);
+    out.write("C8VD", 4);
+    // Version, frames per second, then the frame's hires flag and length
+    for (int byte : {VIDEO_VERSION, 0, FRAME_RATE, 0, 0}) out.put(static_cast<char>(byte));
+    for (int i = 0; i < 4; i++) out.put(static_cast<char>(encoded.size() >> (8 * i)));
+    out.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+    return path.string();
+}
+
+static int check_video_export() {
+    int failures = 0;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "chip8_delta_test";
+    std::filesystem::create_directories(dir);
+    std::string prefix = (dir / "frame").string();
+    std::vector<u_int8_t> valid = varints({0, 1});
+    valid.push_back(0x80);
+    std::vector<u_int8_t> tail = varints({sizeof(chip8::Framebuffer) - 1, 0});
+    valid.insert(valid.end(), tail.begin(), tail.end());
+    if (chip8::export_video_pbm(write_video(dir / "valid.c8vd", valid), prefix) != 0) {
+        std::cerr << "A valid video did not export\n";
+        failures++;
+    }
+    std::vector<u_int8_t> oversized = varints({sizeof(chip8::Framebuffer) - 1, 8});
+    oversized.insert(oversized.end(), 8, 0xFF);
+    if (chip8::export_video_pbm(write_video(dir / "oversized.c8vd", oversized), prefix) != -1) {
+        std::cerr << "A video with a difference past the frame exported\n";
+        failures++;
+    }
+    if (chip8::export_video_pbm(write_video(dir / "truncated.c8vd", varints({0, 40})), prefix) != -1) {
+        std::cerr << "A video with a difference cut short exported\n";
+        failures++;
+    }
+    std::filesystem::remove_all(dir);
+    return failures;
+}
+
+int main() {
+    int failures = check_round_trips() + check_oversized() + check_video_export();
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
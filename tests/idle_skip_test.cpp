@@ -0,0 +1,79 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <vector>
+
+// Runs programs that wait on the delay timer, on a key and by halting, with and without idle skipping, and checks
+// that both end in the same state after the same number of cycles for every cycle limit, rate and engine
+
+struct TestRom {
+    const char *name;
+    std::vector<u_int8_t> bytes;
+};
+
+static TestRom assemble(const char *name, std::vector<u_int16_t> ops) {
+    TestRom rom{name, {}};
+    for (u_int16_t op : ops) {
+        rom.bytes.push_back(op >> 8);
+        rom.bytes.push_back(op & 0xFF);
+    }
+    return rom;
+}
+
+static std::vector<TestRom> test_roms() {
+    std::vector<TestRom> roms;
+    // Draws digits, waits for the timer to run out (3XNN) and to tick once (4XNN), then waits for a key forever
+    roms.push_back(assemble("waits", {
+        0x00E0, 0x6000, 0x6100, 0x6200,
+        0xF029, 0xD125, 0x7105, 0x7001, 0x300F, 0x1208,     // 208: draw digits 0-E
+        0x6305, 0xF315, 0xF407, 0x3400, 0x1218,             // 218: until DT == 0
+        0x6605, 0xF615, 0xF707, 0x4705, 0x1222,             // 222: while DT == 5
+        0xC5FF, 0x7201, 0x4210, 0x1234, 0x6000, 0x1208,
+        0xF80A,                                             // 234: wait for a key
+    }));
+    // Waits for the timer, then halts
+    roms.push_back(assemble("halt", {
+        0x6302, 0xF315, 0xF407, 0x3400, 0x1204, 0x120A,
+    }));
+    return roms;
+}
+
+static int compare(const TestRom &rom, chip8::ExecEngine engine, int cycles_per_frame, bool stop_on_halt,
+        unsigned long cycles) {
+    chip8::EmuOptions options;
+    options.engine = engine;
+    options.cycles_per_frame = cycles_per_frame;
+    options.stop_on_halt = stop_on_halt;
+    options.cycle_limit = cycles;
+    chip8::Chip8Emu skipped, stepped;
+    options.skip_idle = true;
+    if (skipped.run_rom(rom.bytes.data(), rom.bytes.size(), options) != 0) return -1;
+    options.skip_idle = false;
+    if (stepped.run_rom(rom.bytes.data(), rom.bytes.size(), options) != 0) return -1;
+    if (skipped.state_hash() != stepped.state_hash() || skipped.cycles_run() != stepped.cycles_run()) {
+        std::cerr << rom.name << ": idle skipping diverged on engine " << engine << " at " << cycles_per_frame
+            << " cycles per frame" << (stop_on_halt ? ", stopping on halt," : "") << " with a limit of " << cycles
+            << " cycles\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int failures = 0;
+    for (const TestRom &rom : test_roms()) {
+        for (chip8::ExecEngine engine : {chip8::ENGINE_INTERPRETER, chip8::ENGINE_BLOCKS}) {
+            for (int cycles_per_frame : {1, 3, 7, 9, 13, 30}) {
+                for (bool stop_on_halt : {false, true}) {
+                    for (unsigned long cycles = 1; cycles < 3000; cycles += cycles < 300 ? 1 : 37) {
+                        failures += compare(rom, engine, cycles_per_frame, stop_on_halt, cycles) != 0;
+                    }
+                }
+            }
+        }
+    }
+    if (failures) {
+        std::cerr << failures << " runs diverged\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "chip8.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Records a run fed scripted keypad input and checks that replaying the recording, with none of the input and
+// other options, ends in the same state, and that a recording is refused for another program
+
+static std::vector<u_int8_t> assemble(std::vector<u_int16_t> ops) {
+    std::vector<u_int8_t> bytes;
+    for (u_int16_t op : ops) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    return bytes;
+}
+
+// Goes round the keys, adding the number of each one held and a random number per key into V1, and draws a digit
+static const std::vector<u_int8_t> KEYS_ROM = assemble({
+    0x6000,
+    0xE0A1, 0x8104, 0xC20F, 0x8124, 0x7001, 0x4010, 0x6000,     // 202: key V0, wrapping after F
+    0xF229, 0xD125, 0x1202,
+});
+
+#define RECORDED_FRAMES 40
+
+// Holds a different set of keys each frame, like a player would; headless, with no commands or sound
+class ScriptedFrontend : public chip8::Frontend {
+    public:
+        chip8::DisplayBackend *display_backend() override { return nullptr; }
+        chip8::HostCommand next_command() override { return chip8::HOST_NONE; }
+        u_int16_t frame_keys() override {
+            frame++;
+            return frame % 3 ? static_cast<u_int16_t>(frame * 0x9E37) : 0;
+        }
+        bool rewinding() override { return false; }
+        void play(const chip8::SoundFrame &) override {}
+    private:
+        unsigned frame = 0;
+};
+
+static std::string write_rom(const std::filesystem::path &path, const std::vector<u_int8_t> &rom) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(rom.data()), rom.size());
+    return path.string();
+}
+
+int main() {
+    int failures = 0;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "chip8_movie_test";
+    std::filesystem::create_directories(dir);
+    std::string program = write_rom(dir / "keys.ch8", KEYS_ROM);
+    std::string movie = (dir / "keys.c8mv").string();
+
+    // Runs with a frontend are paced, so the recording is kept to a fraction of a second
+    ScriptedFrontend frontend;
+    chip8::EmuOptions recording;
+    recording.frontend = &frontend;
+    recording.seed = 77;
+    recording.cycles_per_frame = 30;
+    recording.cycle_limit = RECORDED_FRAMES * 30;
+    recording.record_file = movie;
+    chip8::Chip8Emu recorded;
+    if (recorded.run_program(program, recording) != 0) return 1;
+
+    // The seed and rate come from the recording, and the run ends where it did
+    chip8::EmuOptions replaying;
+    replaying.replay_file = movie;
+    chip8::Chip8Emu replayed;
+    if (replayed.run_program(program, replaying) != 0 || replayed.cycles_run() != recorded.cycles_run()
+            || replayed.state_hash() != recorded.state_hash()) {
+        std::cerr << "Replaying a recording did not end in the state it was recorded in\n";
+        failures++;
+    }
+
+    // Without the input the same run ends elsewhere, so the replay above did use the keys recorded
+    chip8::EmuOptions no_keys = recording;
+    no_keys.frontend = nullptr;
+    no_keys.record_file.clear();
+    chip8::Chip8Emu unplayed;
+    if (unplayed.run_program(program, no_keys) != 0 || unplayed.state_hash() == recorded.state_hash()) {
+        std::cerr << "A run without the recorded keys ended in the same state\n";
+        failures++;
+    }
+
+    std::vector<u_int8_t> other_rom = KEYS_ROM;
+    other_rom[1] = 0x01;
+    chip8::Chip8Emu other;
+    if (other.run_program(write_rom(dir / "other.ch8", other_rom), replaying) != -1) {
+        std::cerr << "A recording replayed on another program\n";
+        failures++;
+    }
+
+    std::filesystem::remove_all(dir);
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
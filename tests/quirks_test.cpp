@@ -0,0 +1,89 @@
+#include "chip8.hpp"
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// Runs each SUPER-CHIP and XO-CHIP instruction under every quirk profile and checks that it only takes effect
+// with the profiles that have it, and behaves as on the original machines with the others
+
+static std::vector<u_int8_t> assemble(std::vector<u_int16_t> ops) {
+    std::vector<u_int8_t> bytes;
+    for (u_int16_t op : ops) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    return bytes;
+}
+
+// Each program ends in a jump to itself, so a run that gets there has halted; -1 is an illegal instruction
+using Check = std::function<bool(int status, const chip8::Chip8Emu &emulator)>;
+
+struct OpcodeCase {
+    const char *name;
+    std::vector<u_int8_t> rom;
+    // The first profile with the instruction; the profiles are ordered so that every later one has it too
+    chip8::QuirkProfile from;
+    Check with, without;
+};
+
+static u_int8_t reg(const chip8::Chip8Emu &emulator, int index) {
+    return emulator.cpu_state().regs[index];
+}
+
+static std::vector<OpcodeCase> cases() {
+    return {
+        {"00FD", assemble({0x00FD, 0x6001, 0x1204}), chip8::QUIRKS_SCHIP,
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && reg(emulator, 0) == 0; },
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && reg(emulator, 0) == 1; }},
+        {"00FF", assemble({0x00FF, 0x1202}), chip8::QUIRKS_SCHIP,
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && emulator.hires(); },
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && !emulator.hires(); }},
+        {"DXY0", assemble({0xA000, 0xD000, 0xD000, 0x1206}), chip8::QUIRKS_SCHIP,
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && reg(emulator, 0xF) == 1; },
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && reg(emulator, 0xF) == 0; }},
+        {"FX75/FX85", assemble({0x6007, 0xF075, 0x6000, 0xF085, 0x1208}), chip8::QUIRKS_SCHIP,
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && reg(emulator, 0) == 7; },
+            [](int status, const chip8::Chip8Emu &) { return status == -1; }},
+        {"5XY2", assemble({0xA300, 0x6005, 0x5002, 0x6009, 0x1208}), chip8::QUIRKS_XOCHIP,
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && reg(emulator, 0) == 9; },
+            [](int status, const chip8::Chip8Emu &emulator) { return status != -1 && reg(emulator, 0) == 5; }},
+        {"F000", assemble({0xF000, 0x0300, 0x1204}), chip8::QUIRKS_XOCHIP,
+            [](int status, const chip8::Chip8Emu &emulator) {
+                return status != -1 && emulator.cpu_state().I == 0x300;
+            },
+            [](int status, const chip8::Chip8Emu &) { return status == -1; }},
+        {"FN01", assemble({0xF201, 0x1202}), chip8::QUIRKS_XOCHIP,
+            [](int status, const chip8::Chip8Emu &) { return status != -1; },
+            [](int status, const chip8::Chip8Emu &) { return status == -1; }},
+    };
+}
+
+int main() {
+    int failures = 0;
+    for (const OpcodeCase &test : cases()) {
+        for (chip8::QuirkProfile profile : {chip8::QUIRKS_MODERN, chip8::QUIRKS_VIP, chip8::QUIRKS_CHIP48,
+                chip8::QUIRKS_SCHIP, chip8::QUIRKS_XOCHIP}) {
+            for (chip8::ExecEngine engine : {chip8::ENGINE_INTERPRETER, chip8::ENGINE_BLOCKS}) {
+                chip8::EmuOptions options;
+                options.quirks = profile;
+                options.engine = engine;
+                options.stop_on_halt = true;
+                chip8::Chip8Emu emulator;
+                if (emulator.load(test.rom.data(), test.rom.size(), options) != 0) return 1;
+                int status = emulator.step_cycles(20);
+                bool has = profile >= test.from;
+                if (!(has ? test.with : test.without)(status, emulator)) {
+                    // Illegal instructions leave std::cerr printing hex
+                    std::cerr << std::dec << test.name << (has ? " did not take effect" : " took effect")
+                        << " with profile " << profile << " on engine " << engine << '\n';
+                    failures++;
+                }
+            }
+        }
+    }
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
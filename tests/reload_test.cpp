@@ -0,0 +1,84 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <vector>
+
+// Loads a second program into a machine that already ran a first one, and checks that it runs exactly as it does
+// on a machine that never ran anything, through both load and run_rom
+
+static std::vector<u_int8_t> assemble(std::vector<u_int16_t> ops) {
+    std::vector<u_int8_t> bytes;
+    for (u_int16_t op : ops) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    return bytes;
+}
+
+// Leaves every kind of state behind: registers, I, both timers, a stack frame, RAM past the second program, the
+// screen, high resolution and its own length of code
+static const std::vector<u_int8_t> FIRST_ROM = assemble({
+    0x00FF, 0x6A3C, 0xFA15, 0xFA18, 0x6B7F, 0xA400, 0xFB55, 0xA200, 0xD005,
+    0x2216, 0x0000,
+    0x7001, 0x1216,                                                     // 216: a subroutine that never returns
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+});
+
+// Short, and reads what a leftover could change: V0, VB, the delay timer and RAM at 0x400
+static const std::vector<u_int8_t> SECOND_ROM = assemble({
+    0xA400, 0xF065, 0xF107, 0x8014, 0x8B14, 0xA000, 0xD015, 0x120E,
+});
+
+static int compare(chip8::ExecEngine engine, bool run_first_with_run_rom) {
+    chip8::EmuOptions options;
+    options.engine = engine;
+    // For 00FF
+    options.quirks = chip8::QUIRKS_SCHIP;
+    options.cycles_per_frame = 7;
+    options.cycle_limit = 500;
+    chip8::Chip8Emu reused, fresh;
+    if (run_first_with_run_rom) {
+        if (reused.run_rom(FIRST_ROM.data(), FIRST_ROM.size(), options) != 0) return -1;
+    } else if (reused.load(FIRST_ROM.data(), FIRST_ROM.size(), options) != 0 || reused.step_cycles(500) != 0) {
+        return -1;
+    }
+    options.cycle_limit = 0;
+    if (reused.load(SECOND_ROM.data(), SECOND_ROM.size(), options) != 0
+            || fresh.load(SECOND_ROM.data(), SECOND_ROM.size(), options) != 0) {
+        return -1;
+    }
+    if (reused.state_hash() != fresh.state_hash()) {
+        std::cerr << "Loading on engine " << engine << " kept state from the program before\n";
+        return -1;
+    }
+    int reused_status = reused.step_cycles(20), fresh_status = fresh.step_cycles(20);
+    if (reused_status != fresh_status || reused.state_hash() != fresh.state_hash()
+            || reused.cycles_run() != fresh.cycles_run()) {
+        std::cerr << "The second program ran differently on engine " << engine << " after "
+            << (run_first_with_run_rom ? "run_rom" : "load") << '\n';
+        return -1;
+    }
+    // run_rom starts over the same way
+    options.cycle_limit = 5;
+    chip8::Chip8Emu fresh_run;
+    if (reused.run_rom(FIRST_ROM.data(), FIRST_ROM.size(), options) != 0
+            || fresh_run.run_rom(FIRST_ROM.data(), FIRST_ROM.size(), options) != 0
+            || reused.state_hash() != fresh_run.state_hash()) {
+        std::cerr << "run_rom on engine " << engine << " kept state from the program before\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int failures = 0;
+    for (chip8::ExecEngine engine : {chip8::ENGINE_INTERPRETER, chip8::ENGINE_BLOCKS}) {
+        for (bool run_first_with_run_rom : {false, true}) {
+            failures += compare(engine, run_first_with_run_rom) != 0;
+        }
+    }
+    if (failures) {
+        std::cerr << failures << " runs diverged\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "chip8.hpp"
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Pushes the state of every frame of a run into rewind buffers of several sizes, popping some along the way as a
+// rewinding player would, and checks that pops return exactly the states pushed, newest first, across keyframes
+// and after the oldest frames have been evicted
+
+static std::vector<u_int8_t> assemble(std::vector<u_int16_t> ops) {
+    std::vector<u_int8_t> bytes;
+    for (u_int16_t op : ops) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    return bytes;
+}
+
+// Draws random digits at random places and keeps random numbers in RAM
+static const std::vector<u_int8_t> RANDOM_ROM = assemble({
+    0xC03F, 0xC11F, 0xC20F, 0xF229, 0xD015, 0xC3FF, 0xA300, 0xF333, 0x1200,
+});
+
+struct BufferCase {
+    size_t max_frames;
+    size_t capacity_bytes;
+    unsigned keyframe_interval;
+};
+
+// Pops one frame and checks it is the newest one pushed and not yet popped
+static bool pop_newest(chip8::RewindBuffer &buffer, std::vector<chip8::MachineState> &history,
+        chip8::MachineState &state) {
+    if (history.empty() || !buffer.pop(state) || std::memcmp(&state, &history.back(), sizeof state) != 0) {
+        return false;
+    }
+    history.pop_back();
+    return true;
+}
+
+static int check(const BufferCase &test) {
+    chip8::EmuOptions options;
+    chip8::Chip8Emu emulator;
+    if (emulator.load(RANDOM_ROM.data(), RANDOM_ROM.size(), options) != 0) return 1;
+    chip8::RewindBuffer buffer(test.max_frames, test.capacity_bytes, test.keyframe_interval);
+    // Every state pushed and not yet popped, oldest first
+    std::vector<chip8::MachineState> history;
+    chip8::MachineState state;
+    for (int frame = 1; frame <= 600; frame++) {
+        if (emulator.step_frames(1) != 0) return 1;
+        emulator.save_state(state);
+        buffer.push(state);
+        history.push_back(state);
+        if (buffer.frames() > test.max_frames || buffer.bytes_used() > test.capacity_bytes) {
+            std::cerr << "The buffer grew past its limits\n";
+            return 1;
+        }
+        // Now and then rewind a stretch and carry on from the state reached
+        if (frame % 97 == 0) {
+            for (int back = 0; back < 23 && buffer.frames() > 0; back++) {
+                if (!pop_newest(buffer, history, state)) {
+                    std::cerr << "Rewinding at frame " << frame << " did not return the frame pushed last\n";
+                    return 1;
+                }
+            }
+            if (emulator.load_state(state) != 0) return 1;
+        }
+    }
+    size_t held = buffer.frames();
+    if (test.max_frames >= 600 && held != history.size()) {
+        std::cerr << "A buffer with room for every frame held " << held << " of " << history.size() << '\n';
+        return 1;
+    }
+    for (size_t i = 0; i < held; i++) {
+        if (!pop_newest(buffer, history, state)) {
+            std::cerr << "Frame " << i << " back from the end did not match the frame pushed\n";
+            return 1;
+        }
+    }
+    if (buffer.pop(state) || buffer.frames() != 0) {
+        std::cerr << "An emptied buffer still returned a frame\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main() {
+    int failures = 0;
+    // Room for everything; evicting by frame count; evicting by bytes; a keyframe every frame
+    for (const BufferCase &test : {BufferCase{1000, 8 << 20, 60}, BufferCase{100, 8 << 20, 60},
+            BufferCase{1000, 3 * sizeof(chip8::MachineState), 30}, BufferCase{50, 8 << 20, 1}}) {
+        if (check(test) != 0) {
+            std::cerr << "Failed with " << test.max_frames << " frames, " << test.capacity_bytes
+                << " bytes and a keyframe every " << test.keyframe_interval << " frames\n";
+            failures++;
+        }
+    }
+    if (failures) {
+        std::cerr << failures << " buffers failed\n";
+        return 1;
+    }
+    return 0;
+}
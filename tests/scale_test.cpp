@@ -0,0 +1,104 @@
+#include "chip8.hpp"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Scales random frames in both resolutions with every kernel at every scale up to 8, and checks that without
+// persistence each output pixel is the palette colour of its framebuffer pixel, and that with persistence every
+// kernel fades exactly like the scalar one and settles on the same colours
+
+static const chip8::ScaleKernel KERNELS[] = {chip8::SCALE_SCALAR, chip8::SCALE_SSE2, chip8::SCALE_AVX2};
+static const char *const KERNEL_NAMES[] = {"scalar", "SSE2", "AVX2"};
+
+static chip8::Framebuffer random_frame(std::mt19937_64 &random) {
+    chip8::Framebuffer framebuffer;
+    for (chip8::Plane &plane : framebuffer) {
+        for (chip8::PixelRow &row : plane) row = (static_cast<chip8::PixelRow>(random()) << 64) | random();
+    }
+    return framebuffer;
+}
+
+// The colour the framebuffer shows at an output pixel, worked out directly
+static uint32_t expected_colour(const chip8::Framebuffer &framebuffer, bool hires, int scale, int x, int y) {
+    int column = x / scale, row = y / scale;
+    // Low resolution pixels are 2x2 high resolution ones
+    if (!hires) {
+        column /= 2;
+        row /= 2;
+    }
+    int value = 0;
+    for (int plane = 0; plane < PLANES; plane++) value |= chip8::pixel_at(framebuffer, plane, column, row) << plane;
+    return chip8::DEFAULT_PALETTE[value];
+}
+
+static int check_direct(chip8::ScaleKernel kernel, int scale, const std::vector<chip8::Framebuffer> &frames) {
+    chip8::FrameScaler scaler;
+    scaler.configure(scale, 0, kernel);
+    for (size_t i = 0; i < frames.size(); i++) {
+        bool hires = i % 2;
+        const uint32_t *pixels = scaler.render(frames[i], hires);
+        for (int y = 0; y < scaler.height(); y++) {
+            for (int x = 0; x < scaler.width(); x++) {
+                if (pixels[y * scaler.width() + x] != expected_colour(frames[i], hires, scale, x, y)) {
+                    std::cerr << KERNEL_NAMES[kernel] << " at scale " << scale << " drew frame " << i
+                        << " wrong at " << x << ',' << y << '\n';
+                    return 1;
+                }
+            }
+        }
+        if (scaler.fading()) {
+            std::cerr << KERNEL_NAMES[kernel] << " faded without persistence\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int check_persistence(chip8::ScaleKernel kernel, int scale, const std::vector<chip8::Framebuffer> &frames) {
+    chip8::FrameScaler reference, scaler;
+    reference.configure(scale, 0.8, chip8::SCALE_SCALAR);
+    scaler.configure(scale, 0.8, kernel);
+    size_t size = static_cast<size_t>(scaler.width()) * scaler.height();
+    // Changing frames, then the last one held until it has settled
+    for (size_t i = 0; i < frames.size() + 60; i++) {
+        const chip8::Framebuffer &frame = frames[std::min(i, frames.size() - 1)];
+        const uint32_t *expected = reference.render(frame, true);
+        const uint32_t *pixels = scaler.render(frame, true);
+        if (!std::equal(pixels, pixels + size, expected) || scaler.fading() != reference.fading()) {
+            std::cerr << KERNEL_NAMES[kernel] << " at scale " << scale << " faded frame " << i
+                << " unlike the scalar kernel\n";
+            return 1;
+        }
+    }
+    const uint32_t *pixels = scaler.render(frames.back(), true);
+    for (int y = 0; y < scaler.height(); y += scale) {
+        for (int x = 0; x < scaler.width(); x += scale) {
+            if (pixels[y * scaler.width() + x] != expected_colour(frames.back(), true, scale, x, y)) {
+                std::cerr << KERNEL_NAMES[kernel] << " at scale " << scale << " never settled at " << x << ','
+                    << y << '\n';
+                return 1;
+            }
+        }
+    }
+    return scaler.fading();
+}
+
+int main() {
+    std::mt19937_64 random(3);
+    std::vector<chip8::Framebuffer> frames;
+    for (int i = 0; i < 6; i++) frames.push_back(random_frame(random));
+    int failures = 0;
+    // Kernels this CPU cannot run fall back to one it can, which must match just the same
+    for (chip8::ScaleKernel kernel : KERNELS) {
+        for (int scale = 1; scale <= 8; scale++) {
+            failures += check_direct(kernel, scale, frames);
+            failures += check_persistence(kernel, scale, frames);
+        }
+    }
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
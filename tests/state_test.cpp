@@ -0,0 +1,106 @@
+#include "chip8.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Saves the state of a running machine, in memory and to a file, and checks that a new machine restored from it
+// runs on exactly as the original does, and that corrupt or cut short states are rejected without changing anything
+
+static std::vector<u_int8_t> assemble(std::vector<u_int16_t> ops) {
+    std::vector<u_int8_t> bytes;
+    for (u_int16_t op : ops) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    return bytes;
+}
+
+// Draws random digits at random places, calls a subroutine that stores the registers, and keeps the delay timer
+// running, so the state covers the screen, RAM, stack, registers, timers and random numbers
+static const std::vector<u_int8_t> RANDOM_ROM = assemble({
+    0xC03F, 0xC11F, 0xC20F, 0xF229, 0xD015, 0x2210, 0x1200, 0x0000,
+    0xA300, 0xF255, 0x6A1E, 0xFA15, 0x00EE,      // 210: store V0-V2 at 0x300, then set DT
+});
+
+static int load(chip8::Chip8Emu &emulator) {
+    chip8::EmuOptions options;
+    options.seed = 5;
+    return emulator.load(RANDOM_ROM.data(), RANDOM_ROM.size(), options);
+}
+
+static bool same_states(const chip8::MachineState &a, const chip8::MachineState &b) {
+    // save_state clears the whole block first, so padding compares equal too
+    return std::memcmp(&a, &b, sizeof a) == 0;
+}
+
+int main() {
+    int failures = 0;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "chip8_state_test";
+    std::filesystem::create_directories(dir);
+    std::string path = (dir / "saved.state").string();
+
+    chip8::Chip8Emu original;
+    if (load(original) != 0 || original.step_frames(37) != 0) return 1;
+    chip8::MachineState saved;
+    original.save_state(saved);
+    if (original.save_state_file(path) != 0) return 1;
+    if (original.step_frames(90) != 0) return 1;
+
+    chip8::Chip8Emu restored;
+    if (load(restored) != 0 || restored.load_state(saved) != 0 || restored.step_frames(90) != 0
+            || restored.state_hash() != original.state_hash() || !restored.same_state(original)) {
+        std::cerr << "A machine restored from a saved state ran differently\n";
+        failures++;
+    }
+
+    chip8::Chip8Emu from_file;
+    chip8::MachineState reloaded;
+    if (load(from_file) != 0 || from_file.load_state_file(path) != 0) {
+        std::cerr << "A state file did not load\n";
+        failures++;
+    } else {
+        from_file.save_state(reloaded);
+        if (!same_states(saved, reloaded) || from_file.step_frames(90) != 0
+                || from_file.state_hash() != original.state_hash()) {
+            std::cerr << "A state file did not restore the state it was saved from\n";
+            failures++;
+        }
+    }
+
+    chip8::Chip8Emu untouched;
+    if (load(untouched) != 0) return 1;
+    uint64_t before = untouched.state_hash();
+    chip8::MachineState corrupt = saved;
+    corrupt.SP = STACK_MAX + 1;
+    if (untouched.load_state(corrupt) != -1) {
+        std::cerr << "A state with the stack pointer past the stack loaded\n";
+        failures++;
+    }
+    corrupt = saved;
+    corrupt.version = STATE_VERSION + 1;
+    if (untouched.load_state(corrupt) != -1) {
+        std::cerr << "A state of another version loaded\n";
+        failures++;
+    }
+    {
+        std::ofstream out(dir / "truncated.state", std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&saved), sizeof saved / 2);
+    }
+    if (untouched.load_state_file((dir / "truncated.state").string()) != -1) {
+        std::cerr << "A state file cut short loaded\n";
+        failures++;
+    }
+    if (untouched.state_hash() != before) {
+        std::cerr << "Rejected states changed the machine\n";
+        failures++;
+    }
+
+    std::filesystem::remove_all(dir);
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "chip8.hpp"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Runs a program that keeps reading the timers both as one full run and in steps, and checks that both end in the
+// same state for every cycle limit, including limits landing exactly on a frame boundary, for every rate and engine
+
+static std::vector<u_int8_t> assemble(std::vector<u_int16_t> ops) {
+    std::vector<u_int8_t> bytes;
+    for (u_int16_t op : ops) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    return bytes;
+}
+
+// Sets both timers, then draws random digits and sums the delay timer into V2 until it runs out, over and over
+static const std::vector<u_int8_t> TIMERS_ROM = assemble({
+    0x6A0F, 0xFA15, 0xFA18,
+    0xC00F, 0xF029, 0xD005, 0xF107, 0x8214, 0x3100, 0x1206,     // 206: until DT == 0
+    0x1200,
+});
+
+static int compare(chip8::ExecEngine engine, int cycles_per_frame, int cpu_freq, bool skip_idle,
+        unsigned long cycles) {
+    chip8::EmuOptions options;
+    options.engine = engine;
+    options.cycles_per_frame = cycles_per_frame;
+    options.cpu_freq = cpu_freq;
+    options.skip_idle = skip_idle;
+    options.cycle_limit = cycles;
+    chip8::Chip8Emu full, whole, split;
+    if (full.run_rom(TIMERS_ROM.data(), TIMERS_ROM.size(), options) != 0) return -1;
+    options.cycle_limit = 0;
+    if (whole.load(TIMERS_ROM.data(), TIMERS_ROM.size(), options) != 0 || whole.step_cycles(cycles) != 0) return -1;
+    if (split.load(TIMERS_ROM.data(), TIMERS_ROM.size(), options) != 0) return -1;
+    for (unsigned long left = cycles, step = 1; left > 0; step = step % 11 + 1) {
+        unsigned long now = std::min(left, step);
+        if (split.step_cycles(now) != 0) return -1;
+        left -= now;
+    }
+    if (full.state_hash() != whole.state_hash() || full.state_hash() != split.state_hash()
+            || full.cycles_run() != whole.cycles_run() || full.cycles_run() != split.cycles_run()) {
+        std::cerr << "Stepping diverged from a full run on engine " << engine << " at "
+            << (cycles_per_frame ? cycles_per_frame : cpu_freq) << (cycles_per_frame ? " cycles per frame" : " Hz")
+            << (skip_idle ? ", skipping idle frames," : "") << " with a limit of " << cycles << " cycles\n";
+        return -1;
+    }
+    return 0;
+}
+
+// Whole frames of a fixed length end where a cycle limit of as many frames would
+static int compare_frames(chip8::ExecEngine engine, int cycles_per_frame, unsigned long frames) {
+    chip8::EmuOptions options;
+    options.engine = engine;
+    options.cycles_per_frame = cycles_per_frame;
+    options.cycle_limit = frames * cycles_per_frame;
+    chip8::Chip8Emu full, stepped;
+    if (full.run_rom(TIMERS_ROM.data(), TIMERS_ROM.size(), options) != 0) return -1;
+    options.cycle_limit = 0;
+    if (stepped.load(TIMERS_ROM.data(), TIMERS_ROM.size(), options) != 0 || stepped.step_frames(frames) != 0) {
+        return -1;
+    }
+    if (full.state_hash() != stepped.state_hash() || full.cycles_run() != stepped.cycles_run()) {
+        std::cerr << "Stepping " << frames << " frames diverged from a full run on engine " << engine << " at "
+            << cycles_per_frame << " cycles per frame\n";
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int failures = 0;
+    chip8::Chip8Emu unloaded;
+    if (unloaded.step_cycles(1) != -1 || unloaded.step_frames(1) != -1) {
+        std::cerr << "Stepping ran without a program\n";
+        failures++;
+    }
+    for (chip8::ExecEngine engine : {chip8::ENGINE_INTERPRETER, chip8::ENGINE_BLOCKS}) {
+        for (int cycles_per_frame : {1, 4, 7, 10}) {
+            for (bool skip_idle : {false, true}) {
+                for (unsigned long cycles = 1; cycles < 1500; cycles += cycles < 200 ? 1 : 29) {
+                    failures += compare(engine, cycles_per_frame, 0, skip_idle, cycles) != 0;
+                }
+            }
+            for (unsigned long frames = 1; frames < 100; frames++) {
+                failures += compare_frames(engine, cycles_per_frame, frames) != 0;
+            }
+        }
+        // Rates that are no whole number of cycles per frame
+        for (int cpu_freq : {90, 500, 1000}) {
+            for (unsigned long cycles = 1; cycles < 1500; cycles += cycles < 200 ? 1 : 29) {
+                failures += compare(engine, 0, cpu_freq, false, cycles) != 0;
+            }
+        }
+    }
+    if (failures) {
+        std::cerr << failures << " runs diverged\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "chip8.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// Dumps a trace and reads it back, and checks that traces counting more records than they hold are rejected
+// without allocating for the count
+
+static std::string write_file(const std::filesystem::path &path, const std::vector<char> &bytes) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(bytes.data(), bytes.size());
+    return path.string();
+}
+
+static std::vector<char> read_file(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+int main() {
+    int failures = 0;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "chip8_trace_test";
+    std::filesystem::create_directories(dir);
+
+    // More records than the ring holds, so only the last ones are dumped
+    chip8::Tracer tracer(8);
+    std::array<u_int8_t, chip8::REG_MAX> regs = {};
+    for (int i = 0; i < 20; i++) {
+        regs[i % chip8::REG_MAX] = i;
+        tracer.record(0x200 + 2 * i, 0x6000 + i, 0, regs, i, 0);
+    }
+    std::string path = (dir / "valid.c8tr").string();
+    std::vector<chip8::TraceRecord> records;
+    if (tracer.dump(path) != 0 || chip8::read_trace(path, records) != 0 || records.size() != 8
+            || records.front().cycle != 12 || records.back().cycle != 19 || records.back().addr != 0x200 + 2 * 19) {
+        std::cerr << "A dumped trace did not read back\n";
+        failures++;
+    }
+
+    std::vector<char> valid = read_file(path);
+    // The record count follows the magic, version and record size
+    size_t count_offset = sizeof(u_int32_t) + 2 * sizeof(u_int16_t);
+    std::vector<char> truncated(valid.begin(), valid.end() - sizeof(chip8::TraceRecord) / 2);
+    if (chip8::read_trace(write_file(dir / "truncated.c8tr", truncated), records) != -1) {
+        std::cerr << "A trace cut short was read\n";
+        failures++;
+    }
+    std::vector<char> huge = valid;
+    u_int64_t count = UINT64_MAX / 2;
+    std::copy_n(reinterpret_cast<const char *>(&count), sizeof count, huge.begin() + count_offset);
+    if (chip8::read_trace(write_file(dir / "huge.c8tr", huge), records) != -1) {
+        std::cerr << "A trace counting more records than it holds was read\n";
+        failures++;
+    }
+    std::vector<char> header_only(valid.begin(), valid.begin() + count_offset + sizeof count);
+    if (chip8::read_trace(write_file(dir / "header.c8tr", header_only), records) != -1) {
+        std::cerr << "A trace with only a header was read\n";
+        failures++;
+    }
+
+    std::filesystem::remove_all(dir);
+    if (failures) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
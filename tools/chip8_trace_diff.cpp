@@ -0,0 +1,79 @@
+#include "chip8.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+static void print_record(const char *label, const chip8::TraceRecord &record) {
+    std::cout << label << std::hex << std::setfill('0')
+        << " cycle " << std::dec << record.cycle << std::hex
+        << "  addr " << std::setw(3) << record.addr
+        << "  op " << std::setw(4) << record.opcode
+        << "  I " << std::setw(3) << record.I
+        << "  SP " << static_cast<int>(record.SP)
+        << "  status " << std::dec << static_cast<int>(record.status) << std::hex << "\n     ";
+    for (int reg = 0; reg < chip8::REG_MAX; reg++) {
+        std::cout << " V" << std::uppercase << reg << std::nouppercase << '='
+            << std::setw(2) << static_cast<int>(record.regs[reg])
+            << ((record.changed >> reg) & 1 ? '*' : ' ');
+    }
+    std::cout << std::dec << std::setfill(' ') << '\n';
+}
+
+static void print_differences(const chip8::TraceRecord &a, const chip8::TraceRecord &b) {
+    std::cout << "differs in:";
+    if (a.cycle != b.cycle) std::cout << " cycle";
+    if (a.addr != b.addr) std::cout << " addr";
+    if (a.opcode != b.opcode) std::cout << " opcode";
+    if (a.I != b.I) std::cout << " I";
+    if (a.SP != b.SP) std::cout << " SP";
+    if (a.status != b.status) std::cout << " status";
+    for (int reg = 0; reg < chip8::REG_MAX; reg++) {
+        if (a.regs[reg] != b.regs[reg]) std::cout << " V" << std::hex << std::uppercase << reg << std::dec;
+    }
+    std::cout << '\n';
+}
+
+static bool same_record(const chip8::TraceRecord &a, const chip8::TraceRecord &b) {
+    // changed follows from the registers of the previous record, so it is not compared on its own
+    return a.cycle == b.cycle && a.addr == b.addr && a.opcode == b.opcode && a.I == b.I && a.SP == b.SP
+        && a.status == b.status && a.regs == b.regs;
+}
+
+// Exits with 0 when the traces agree over the cycles both hold, 1 at the first divergence
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: chip8_trace_diff TRACE_A TRACE_B\n";
+        return -1;
+    }
+    std::vector<chip8::TraceRecord> a, b;
+    if (chip8::read_trace(argv[1], a) != 0 || chip8::read_trace(argv[2], b) != 0) {
+        return -1;
+    }
+    if (a.empty() || b.empty()) {
+        std::cout << "Nothing to compare: " << (a.empty() ? argv[1] : argv[2]) << " holds no records\n";
+        return 0;
+    }
+    // Ring buffers of different sizes keep different amounts of history, so both are started at the
+    // first cycle they both hold
+    u_int64_t start = std::max(a.front().cycle, b.front().cycle);
+    size_t i = 0, j = 0;
+    while (i < a.size() && a[i].cycle < start) ++i;
+    while (j < b.size() && b[j].cycle < start) ++j;
+    size_t compared = 0;
+    for (; i < a.size() && j < b.size(); ++i, ++j, ++compared) {
+        if (!same_record(a[i], b[j])) {
+            std::cout << "First divergence after " << compared << " matching records\n";
+            print_record("A:  ", a[i]);
+            print_record("B:  ", b[j]);
+            print_differences(a[i], b[j]);
+            return 1;
+        }
+    }
+    std::cout << "No divergence in " << compared << " records from cycle " << start << '\n';
+    if (i < a.size() || j < b.size()) {
+        std::cout << (i < a.size() ? argv[1] : argv[2]) << " continues for " << (i < a.size() ? a.size() - i : b.size() - j)
+            << " more records\n";
+    }
+    return 0;
+}